@@ -0,0 +1,213 @@
+#include <string.h>
+#include "analyze.h"
+
+#define MAX_PENDING 4096 // block starts waiting to be followed
+#define MAX_JUMP_TABLE 128 // entries followed after the base of a computed jump
+
+typedef struct Walker {
+    const Chip_8 *chip;
+    Rom_Analysis *analysis;
+    uint16_t pending[MAX_PENDING];
+    unsigned int pending_count;
+} Walker;
+
+// F000 nnnn of XO-CHIP is the only instruction that is four bytes long
+static int instruction_length(const Chip_8 *chip, uint16_t address) {
+    return chip->machine == MACHINE_XO_CHIP && fetch_opcode(chip, address) == 0xF000 ? 4 : 2;
+}
+
+// marks a block start and queues it once
+static void add_leader(Walker *walker, uint16_t address) {
+    Rom_Analysis *analysis = walker->analysis;
+    address &= walker->chip->address_mask;
+    // the interpreter and the fonts live below 0x200
+    if (address < 0x200) {
+        analysis->partial = true;
+        return;
+    }
+    if (analysis->flags[address] & BYTE_LEADER) return;
+    analysis->flags[address] |= BYTE_LEADER;
+    if (walker->pending_count == MAX_PENDING) analysis->partial = true;
+    else walker->pending[walker->pending_count++] = address;
+}
+
+static void mark(Rom_Analysis *analysis, const Chip_8 *chip, int I, int count, uint8_t flag) {
+    if (I < 0) return;
+    for (int i = 0; i < count; i++) analysis->flags[(I + i) & chip->address_mask] |= flag;
+}
+
+// where execution continues after the instruction at `address`, returns the number of successors.
+// `branch` is set if the instruction doesn't simply fall through to the next one
+static int successors(const Chip_8 *chip, uint16_t address, uint16_t next[2], bool *branch) {
+    uint16_t opcode = fetch_opcode(chip, address);
+    uint16_t nnn = opcode & 0x0FFF;
+    uint16_t after = (address + instruction_length(chip, address)) & chip->address_mask;
+    Instruction in;
+    decode_instruction(opcode, chip->machine, chip->quirks, &in);
+    *branch = true;
+    if (is_unknown_opcode(&in) || opcode == 0x00EE || opcode == 0x00FD) return 0;
+    switch (opcode >> 12) {
+        case 0x1:
+        case 0xB: // the base of the jump, add_jump_table() follows the rest
+            next[0] = nnn;
+            return 1;
+        case 0x2:
+            next[0] = nnn;
+            next[1] = after;
+            return 2;
+        case 0x3:
+        case 0x4:
+        case 0x5:
+        case 0x9:
+        case 0xE:
+            // 5xy2 and 5xy3 are XO-CHIP loads and stores
+            if (instruction_class(&in) == CLASS_SAVE || instruction_class(&in) == CLASS_LOAD) break;
+            next[0] = after;
+            // on XO-CHIP F000 nnnn is skipped as a whole, see skip_next()
+            next[1] = (after + instruction_length(chip, after)) & chip->address_mask;
+            return 2;
+    }
+    *branch = false;
+    next[0] = after;
+    return 1;
+}
+
+// Bnnn usually jumps into a table of jumps, follows the jumps right after the base
+static void add_jump_table(Walker *walker, uint16_t base) {
+    walker->analysis->flags[base & walker->chip->address_mask] |= BYTE_INDIRECT;
+    for (int i = 1; i < MAX_JUMP_TABLE; i++) {
+        uint16_t entry = (base + 2 * i) & walker->chip->address_mask;
+        if ((fetch_opcode(walker->chip, entry) & 0xF000) != 0x1000) break;
+        add_leader(walker, entry);
+    }
+    // anything past the table can't be known without the register
+    walker->analysis->partial = true;
+}
+
+// follows the code from a block start until it branches, tracking I to find the bytes it reads and writes
+static void follow(Walker *walker, uint16_t address) {
+    const Chip_8 *chip = walker->chip;
+    Rom_Analysis *analysis = walker->analysis;
+    int I = -1; // unknown
+    for (;;) {
+        if (analysis->flags[address] & BYTE_INSTRUCTION) return;
+        int length = instruction_length(chip, address);
+        analysis->flags[address] |= BYTE_INSTRUCTION;
+        mark(analysis, chip, address, length, BYTE_CODE);
+
+        uint16_t opcode = fetch_opcode(chip, address);
+        unsigned int x = (opcode >> 8) & 0xF, y = (opcode >> 4) & 0xF, n = opcode & 0xF;
+        switch (opcode >> 12) {
+            case 0x5:
+                if (chip->machine != MACHINE_XO_CHIP) break;
+                if (n == 0x2) mark(analysis, chip, I, (x > y ? x - y : y - x) + 1, BYTE_WRITTEN);
+                if (n == 0x3) mark(analysis, chip, I, (x > y ? x - y : y - x) + 1, BYTE_DATA);
+                break;
+            case 0xA:
+                I = opcode & 0x0FFF;
+                break;
+            case 0xD:
+                // Dxy0 draws a 16x16 sprite on SCHIP and XO-CHIP
+                mark(analysis, chip, I, n ? n : chip->machine == MACHINE_CHIP8 ? 0 : 32, BYTE_SPRITE);
+                break;
+            case 0xF:
+                if (opcode == 0xF000) I = fetch_opcode(chip, address + 2);
+                else if ((opcode & 0xFF) == 0x33) mark(analysis, chip, I, 3, BYTE_WRITTEN);
+                else if ((opcode & 0xFF) == 0x55) mark(analysis, chip, I, x + 1, BYTE_WRITTEN);
+                else if ((opcode & 0xFF) == 0x65) mark(analysis, chip, I, x + 1, BYTE_DATA);
+                // Fx1E, Fx29, Fx30 and the quirk of Fx55 / Fx65 move I
+                if (opcode != 0xF000 && (opcode & 0xFF) != 0x33) I = -1;
+                break;
+        }
+
+        uint16_t next[2];
+        bool branch;
+        int count = successors(chip, address, next, &branch);
+        if (!branch) {
+            address = next[0];
+            continue;
+        }
+        for (int i = 0; i < count; i++) add_leader(walker, next[i]);
+        if (opcode >> 12 == 0xB) add_jump_table(walker, next[0]);
+        return;
+    }
+}
+
+// splits the followed code into basic blocks at every block start and branch
+static void collect_blocks(const Chip_8 *chip, Rom_Analysis *analysis) {
+    for (unsigned int start = 0x200; start <= chip->address_mask; start++) {
+        if ((analysis->flags[start] & (BYTE_LEADER | BYTE_INSTRUCTION)) != (BYTE_LEADER | BYTE_INSTRUCTION)) continue;
+        if (analysis->block_count == MAX_CODE_BLOCKS) {
+            analysis->partial = true;
+            return;
+        }
+        Code_Block *block = &analysis->blocks[analysis->block_count++];
+        block->start = (uint16_t) start;
+        uint16_t address = (uint16_t) start;
+        for (;;) {
+            bool branch;
+            block->next_count = (uint8_t) successors(chip, address, block->next, &branch);
+            block->end = (address + instruction_length(chip, address)) & chip->address_mask;
+            if (branch) break;
+            address = block->next[0];
+            // falls through into the next block
+            if (address <= start || analysis->flags[address] & BYTE_LEADER ||
+                !(analysis->flags[address] & BYTE_INSTRUCTION))
+                break;
+        }
+    }
+}
+
+void analyze_rom(const Chip_8 *chip, Rom_Analysis *analysis) {
+    memset(analysis, 0, sizeof(*analysis));
+    analysis->program = program_hash(chip);
+    analysis->machine = chip->machine;
+
+    Walker walker;
+    walker.chip = chip;
+    walker.analysis = analysis;
+    walker.pending_count = 0;
+    add_leader(&walker, 0x200);
+    while (walker.pending_count) follow(&walker, walker.pending[--walker.pending_count]);
+    collect_blocks(chip, analysis);
+}
+
+void predecode_rom(const Rom_Analysis *analysis, Chip_8 *chip, Engine *engine) {
+    if (engine->type == ENGINE_INTERPRETER) return;
+    for (unsigned int address = 0x200; address <= chip->address_mask; address++) {
+        uint8_t flags = analysis->flags[address];
+        if (!(flags & BYTE_INSTRUCTION) || flags & BYTE_WRITTEN) continue;
+        if (engine->type == ENGINE_DECODE_CACHE) {
+            predecode(chip, engine, (uint16_t) address);
+            continue;
+        }
+        // blocks start at the basic blocks and after instructions that end a translated block
+        if (flags & BYTE_LEADER) predecode(chip, engine, (uint16_t) address);
+        Instruction in;
+        decode_instruction(fetch_opcode(chip, (uint16_t) address), chip->machine, chip->quirks, &in);
+        uint16_t after = (address + instruction_length(chip, (uint16_t) address)) & chip->address_mask;
+        if (ends_block(&in) && analysis->flags[after] & BYTE_INSTRUCTION && !(analysis->flags[after] & BYTE_WRITTEN))
+            predecode(chip, engine, after);
+    }
+}
+
+void init_analysis_cache(Analysis_Cache *cache) {
+    cache->used = 0;
+    cache->next = 0;
+}
+
+const Rom_Analysis *lookup_analysis(Analysis_Cache *cache, const Chip_8 *chip) {
+    uint64_t program = program_hash(chip);
+    for (unsigned int i = 0; i < cache->used; i++) {
+        const Rom_Analysis *entry = &cache->entries[i];
+        if (entry->program == program && entry->machine == chip->machine) return entry;
+    }
+    Rom_Analysis *entry;
+    if (cache->used < ANALYSIS_CACHE_SIZE) entry = &cache->entries[cache->used++];
+    else {
+        entry = &cache->entries[cache->next];
+        cache->next = (cache->next + 1) % ANALYSIS_CACHE_SIZE;
+    }
+    analyze_rom(chip, entry);
+    return entry;
+}
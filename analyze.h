@@ -0,0 +1,61 @@
+#ifndef CHIP_8_ANALYZE_H
+#define CHIP_8_ANALYZE_H
+
+#include "chip8.h"
+
+// static analysis of a loaded rom. follows the control flow from 0x200 through jumps, calls, skips
+// and jump tables (Bnnn) without running anything, recovers the basic blocks and tells code from
+// sprites and data. the engines use the result to decode the code before the first frame
+
+// flags per byte of memory
+#define BYTE_INSTRUCTION 0x01 // first byte of a reachable instruction
+#define BYTE_CODE 0x02 // any byte of a reachable instruction
+#define BYTE_LEADER 0x04 // first byte of a basic block
+#define BYTE_SPRITE 0x08 // drawn by Dxyn, I pointed here
+#define BYTE_DATA 0x10 // read by Fx65
+#define BYTE_WRITTEN 0x20 // written by Fx33 or Fx55, code here modifies itself
+#define BYTE_INDIRECT 0x40 // base of a computed jump (Bnnn), the real target depends on a register
+
+#define MAX_CODE_BLOCKS 4096
+
+// instructions executed one after another, only the last one can branch
+typedef struct Code_Block {
+    uint16_t start;
+    uint16_t end; // address after the last instruction
+    uint16_t next[2]; // successors, a call continues at its target and the address after it
+    uint8_t next_count; // 0 after a return, an exit or an unknown opcode
+} Code_Block;
+
+typedef struct Rom_Analysis {
+    uint64_t program; // program_hash() of the analyzed rom
+    Machine machine;
+    uint8_t flags[MEMORY_SIZE]; // BYTE_* per address
+    Code_Block blocks[MAX_CODE_BLOCKS]; // ordered by address
+    unsigned int block_count;
+    // targets were missed, e.g. computed jumps outside a jump table or code below 0x200.
+    // the code still decodes at runtime, the analysis only can't tell it from data
+    bool partial;
+} Rom_Analysis;
+
+void analyze_rom(const Chip_8 *chip, Rom_Analysis *analysis);
+// decodes the code found by the analysis into the decode cache, or translates its blocks for the
+// blocks engine. code that modifies itself is left to be decoded when it runs
+void predecode_rom(const Rom_Analysis *analysis, Chip_8 *chip, Engine *engine);
+
+// analyses of recently loaded roms, large enough to be kept in static storage. it only lives as long as
+// the process and is keyed by program_hash(), so it saves work only when one process loads the same rom
+// again, e.g. a frontend restarting it. a library stores identical roms once, so a run over a library
+// still analyses every rom once
+#define ANALYSIS_CACHE_SIZE 8
+
+typedef struct Analysis_Cache {
+    Rom_Analysis entries[ANALYSIS_CACHE_SIZE];
+    unsigned int used;
+    unsigned int next; // entry replaced next once all are used
+} Analysis_Cache;
+
+void init_analysis_cache(Analysis_Cache *cache);
+// the analysis of the rom loaded into `chip`, analyzed on the first request for its program hash
+const Rom_Analysis *lookup_analysis(Analysis_Cache *cache, const Chip_8 *chip);
+
+#endif //CHIP_8_ANALYZE_H
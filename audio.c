@@ -0,0 +1,99 @@
+#include <math.h>
+#include <string.h>
+#include "audio.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+void init_synth(Synth *synth) {
+    for (int i = 0; i < WAVETABLE_SIZE; i++) {
+        synth->wavetable[i] = (int16_t) (AMPLITUDE * sin(2 * M_PI * i / WAVETABLE_SIZE));
+    }
+    synth->phase = 0;
+    synth->step = (uint32_t) (FREQUENCY * 4294967296.0 / AUDIO_RATE);
+    synth->position = 0;
+    synth->on = false;
+    synth->use_pattern = false;
+    memset(synth->pattern, 0, sizeof(synth->pattern));
+    atomic_init(&synth->events.head, 0);
+    atomic_init(&synth->events.tail, 0);
+}
+
+bool queue_tone(Synth *synth, const Tone_Event *event) {
+    Tone_Ring *ring = &synth->events;
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail == TONE_RING_SIZE) return false;
+    ring->events[head & (TONE_RING_SIZE - 1)] = *event;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+// returns the next change due before `end`, NULL if there is none
+static const Tone_Event *next_tone(Synth *synth, uint64_t end) {
+    Tone_Ring *ring = &synth->events;
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (head == tail) return NULL;
+    const Tone_Event *event = &ring->events[tail & (TONE_RING_SIZE - 1)];
+    return event->sample < end ? event : NULL;
+}
+
+static void apply_tone(Synth *synth, const Tone_Event *event) {
+    synth->on = event->on;
+    synth->use_pattern = event->use_pattern;
+    if (event->use_pattern) {
+        memcpy(synth->pattern, event->pattern, sizeof(synth->pattern));
+        // the pattern plays at 4000 * 2^((pitch - 64) / 48) bits per second, a period is 128 bits
+        double rate = 4000.0 * pow(2.0, (event->pitch - 64) / 48.0);
+        synth->step = (uint32_t) (rate / 128 * 4294967296.0 / AUDIO_RATE);
+    } else {
+        synth->step = (uint32_t) (FREQUENCY * 4294967296.0 / AUDIO_RATE);
+    }
+    atomic_fetch_add_explicit(&synth->events.tail, 1, memory_order_release);
+}
+
+void render_audio(Synth *synth, int16_t *out, int count) {
+    uint64_t end = synth->position + count;
+    int i = 0;
+    while (i < count) {
+        // render up to the next change, changes that are already late apply right away
+        const Tone_Event *event = next_tone(synth, end);
+        int until = count;
+        if (event) until = event->sample > synth->position + i ? (int) (event->sample - synth->position) : i;
+
+        if (!synth->on) {
+            memset(&out[i], 0, (until - i) * sizeof(int16_t));
+            i = until;
+        } else if (synth->use_pattern) {
+            for (; i < until; i++) {
+                unsigned int bit = synth->phase >> 25; // 128 bits per period
+                out[i] = (synth->pattern[bit >> 3] >> (7 - (bit & 7))) & 1 ? AMPLITUDE : -AMPLITUDE;
+                synth->phase += synth->step;
+            }
+        } else {
+            for (; i < until; i++) {
+                out[i] = synth->wavetable[synth->phase >> (32 - 8)];
+                synth->phase += synth->step;
+            }
+        }
+        if (event) apply_tone(synth, event);
+    }
+    synth->position = end;
+}
+
+void update_tone(Synth *synth, const Chip_8 *chip, uint64_t frame, bool *beeping) {
+    // keep the tone playing until sound_register runs out, starting at the sample this frame ends on.
+    // XO-CHIP programs that loaded a pattern play it instead of the tone
+    bool on = chip->sound_register > 0;
+    if (on == *beeping && !(on && chip->audio_flag)) return;
+    Tone_Event tone = {0};
+    tone.sample = frame * FRAME_SAMPLES;
+    tone.on = on;
+    for (int i = 0; i < 16 && chip->machine == MACHINE_XO_CHIP; i++) tone.use_pattern |= chip->pattern[i] != 0;
+    tone.pitch = chip->pitch;
+    memcpy(tone.pattern, chip->pattern, sizeof(tone.pattern));
+    queue_tone(synth, &tone);
+    *beeping = on;
+}
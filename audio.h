@@ -0,0 +1,55 @@
+#ifndef CHIP_8_AUDIO_H
+#define CHIP_8_AUDIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "chip8.h"
+
+// audio-config
+#define AUDIO_RATE 48000
+#define AMPLITUDE 15000
+#define FREQUENCY 440.0 // 440 Hz == A
+#define WAVETABLE_SIZE 256 // power of two
+#define FRAME_SAMPLES (AUDIO_RATE / TIMER_HZ) // samples per 60 Hz frame
+
+// a change of the tone, queued by the emulation thread
+typedef struct Tone_Event {
+    uint64_t sample; // sample position the change takes effect at
+    bool on;
+    bool use_pattern; // play `pattern` (XO-CHIP) instead of the sine tone
+    uint8_t pitch; // XO-CHIP pitch register, 64 == 4000 Hz
+    uint8_t pattern[16]; // 128 1-bit samples, most significant bit first
+} Tone_Event;
+
+#define TONE_RING_SIZE 64 // power of two
+
+// single producer, single consumer ring of tone changes
+typedef struct Tone_Ring {
+    Tone_Event events[TONE_RING_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+} Tone_Ring;
+
+// phase-accumulator oscillator, the phase is kept across buffers so the tone doesn't click
+typedef struct Synth {
+    int16_t wavetable[WAVETABLE_SIZE]; // one period of the sine tone
+    uint32_t phase; // position in the current period, a full period is 2^32
+    uint32_t step; // phase increment per sample
+    uint64_t position; // samples rendered so far
+    bool on;
+    bool use_pattern;
+    uint8_t pattern[16];
+    Tone_Ring events;
+} Synth;
+
+void init_synth(Synth *synth);
+// queues a tone change, returns false if the queue is full
+bool queue_tone(Synth *synth, const Tone_Event *event);
+// renders `count` mono samples, applying queued changes at their sample position
+void render_audio(Synth *synth, int16_t *out, int count);
+// queues the tone of `chip` at the end of frame `frame` if it started, stopped or the XO-CHIP pattern changed.
+// `beeping` is the state of the tone, kept by the caller between frames. chip->audio_flag is left set
+void update_tone(Synth *synth, const Chip_8 *chip, uint64_t frame, bool *beeping);
+
+#endif //CHIP_8_AUDIO_H
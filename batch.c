@@ -0,0 +1,218 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "batch.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define MAX_WORKERS 256
+#define BATCH_CHUNK 16 // machines taken at once from a range
+
+// the range of machines a worker starts with, padded so workers don't share cache lines
+typedef struct Work_Range {
+    atomic_uint next;
+    unsigned int end;
+    char padding[64 - sizeof(atomic_uint) - sizeof(unsigned int)];
+} Work_Range;
+
+struct Chip8_Batch {
+    Chip_8 *machines;
+    unsigned int *frame_cycles; // instructions each machine ran since its last timer tick
+    unsigned int count;
+    unsigned int cycles_per_frame;
+    Machine machine; // the instruction set the table is decoded for
+    Instruction *table; // shared by all machines
+
+    unsigned int workers; // including the thread calling chip8_batch_step()
+    pthread_t threads[MAX_WORKERS];
+    Work_Range ranges[MAX_WORKERS];
+
+    // a step is started by bumping `generation`, workers report back through `running`
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long generation;
+    unsigned int running;
+    unsigned int cycles; // instructions per machine in the current step
+    bool quit;
+};
+
+static unsigned int core_count() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (unsigned int) cores : 1;
+#endif
+}
+
+static void step_machine(Chip8_Batch *batch, unsigned int index) {
+    Chip_8 *chip = &batch->machines[index];
+    unsigned int phase = batch->frame_cycles[index];
+    unsigned int remaining = batch->cycles;
+    while (remaining && !chip->halted) {
+        unsigned int budget = batch->cycles_per_frame - phase;
+        if (budget > remaining) budget = remaining;
+        unsigned int executed = run_opcode_table(chip, batch->table, budget);
+        remaining -= executed;
+        phase += executed;
+        if (phase >= batch->cycles_per_frame) {
+            end_frame(chip);
+            phase = 0;
+        }
+    }
+    batch->frame_cycles[index] = phase;
+}
+
+// takes chunks from its own range first, then steals from the others
+static void run_worker(Chip8_Batch *batch, unsigned int worker) {
+    for (unsigned int n = 0; n < batch->workers; n++) {
+        Work_Range *range = &batch->ranges[(worker + n) % batch->workers];
+        for (;;) {
+            unsigned int first = atomic_fetch_add(&range->next, BATCH_CHUNK);
+            if (first >= range->end) break;
+            unsigned int last = first + BATCH_CHUNK < range->end ? first + BATCH_CHUNK : range->end;
+            for (unsigned int i = first; i < last; i++) step_machine(batch, i);
+        }
+    }
+}
+
+typedef struct Worker_Start {
+    Chip8_Batch *batch;
+    unsigned int worker;
+} Worker_Start;
+
+static void *worker_thread(void *data) {
+    Worker_Start start = *(Worker_Start *) data;
+    free(data);
+    Chip8_Batch *batch = start.batch;
+    unsigned long generation = 0;
+
+    pthread_mutex_lock(&batch->lock);
+    for (;;) {
+        while (batch->generation == generation && !batch->quit) pthread_cond_wait(&batch->start, &batch->lock);
+        if (batch->quit) break;
+        generation = batch->generation;
+        pthread_mutex_unlock(&batch->lock);
+
+        run_worker(batch, start.worker);
+
+        pthread_mutex_lock(&batch->lock);
+        if (--batch->running == 0) pthread_cond_signal(&batch->done);
+    }
+    pthread_mutex_unlock(&batch->lock);
+    return NULL;
+}
+
+Chip8_Batch *chip8_batch_create(unsigned int count, unsigned int threads) {
+    Chip8_Batch *batch = calloc(1, sizeof(Chip8_Batch));
+    if (!batch) return NULL;
+    batch->machines = malloc(count * sizeof(Chip_8));
+    batch->frame_cycles = calloc(count, sizeof(unsigned int));
+    batch->table = malloc(OPCODE_TABLE_SIZE * sizeof(Instruction));
+    if (!batch->machines || !batch->frame_cycles || !batch->table) {
+        chip8_batch_destroy(batch);
+        return NULL;
+    }
+    batch->count = count;
+    batch->cycles_per_frame = CYCLES_PER_FRAME;
+    for (unsigned int i = 0; i < count; i++) init_chip(&batch->machines[i]);
+    batch->machine = MACHINE_CHIP8;
+    init_opcode_table(batch->table, MACHINE_CHIP8, QUIRKS_CHIP8);
+
+    if (threads == 0) threads = core_count();
+    if (threads > MAX_WORKERS) threads = MAX_WORKERS;
+    if (threads > count) threads = count ? count : 1;
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->start, NULL);
+    pthread_cond_init(&batch->done, NULL);
+    batch->workers = 1;
+    for (unsigned int i = 1; i < threads; i++) {
+        Worker_Start *start = malloc(sizeof(Worker_Start));
+        if (!start) break;
+        start->batch = batch;
+        start->worker = i;
+        if (pthread_create(&batch->threads[i], NULL, worker_thread, start) != 0) {
+            free(start);
+            break;
+        }
+        batch->workers++;
+    }
+    return batch;
+}
+
+void chip8_batch_destroy(Chip8_Batch *batch) {
+    if (!batch) return;
+    if (batch->workers > 1) {
+        pthread_mutex_lock(&batch->lock);
+        batch->quit = true;
+        pthread_cond_broadcast(&batch->start);
+        pthread_mutex_unlock(&batch->lock);
+        for (unsigned int i = 1; i < batch->workers; i++) pthread_join(batch->threads[i], NULL);
+    }
+    if (batch->workers) {
+        pthread_mutex_destroy(&batch->lock);
+        pthread_cond_destroy(&batch->start);
+        pthread_cond_destroy(&batch->done);
+    }
+    free(batch->machines);
+    free(batch->frame_cycles);
+    free(batch->table);
+    free(batch);
+}
+
+unsigned int chip8_batch_count(const Chip8_Batch *batch) {
+    return batch->count;
+}
+
+Chip_8 *chip8_batch_machine(Chip8_Batch *batch, unsigned int index) {
+    return index < batch->count ? &batch->machines[index] : NULL;
+}
+
+void chip8_batch_set_cycles_per_frame(Chip8_Batch *batch, unsigned int cycles_per_frame) {
+    if (cycles_per_frame == 0) return;
+    batch->cycles_per_frame = cycles_per_frame;
+    for (unsigned int i = 0; i < batch->count; i++) batch->frame_cycles[i] = 0;
+}
+
+void chip8_batch_set_machine(Chip8_Batch *batch, Machine machine) {
+    batch->machine = machine;
+    init_opcode_table(batch->table, machine, machine_quirks(machine));
+    for (unsigned int i = 0; i < batch->count; i++) set_machine(&batch->machines[i], machine);
+}
+
+void chip8_batch_set_quirks(Chip8_Batch *batch, uint8_t quirks) {
+    init_opcode_table(batch->table, batch->machine, quirks);
+    for (unsigned int i = 0; i < batch->count; i++) set_quirks(&batch->machines[i], quirks);
+}
+
+void chip8_batch_step(Chip8_Batch *batch, unsigned int cycles) {
+    // split the machines into one range per worker
+    for (unsigned int w = 0; w < batch->workers; w++) {
+        atomic_store(&batch->ranges[w].next, (unsigned int) ((unsigned long long) batch->count * w / batch->workers));
+        batch->ranges[w].end = (unsigned int) ((unsigned long long) batch->count * (w + 1) / batch->workers);
+    }
+    batch->cycles = cycles;
+
+    if (batch->workers > 1) {
+        pthread_mutex_lock(&batch->lock);
+        batch->running = batch->workers - 1;
+        batch->generation++;
+        pthread_cond_broadcast(&batch->start);
+        pthread_mutex_unlock(&batch->lock);
+    }
+
+    run_worker(batch, 0);
+
+    if (batch->workers > 1) {
+        pthread_mutex_lock(&batch->lock);
+        while (batch->running) pthread_cond_wait(&batch->done, &batch->lock);
+        pthread_mutex_unlock(&batch->lock);
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef CHIP_8_BATCH_H
+#define CHIP_8_BATCH_H
+
+#include "chip8.h"
+
+// runs many independent machines across all cores, e.g. for fuzzing or searching rom behaviour.
+// machines are stepped by a pool of worker threads, each worker owns a range of machines and
+// steals chunks from the other ranges once its own is done. all machines share one read-only
+// opcode table instead of keeping a decode cache each
+
+typedef struct Chip8_Batch Chip8_Batch;
+
+// creates `count` machines in their reset state, `threads` == 0 uses one worker per core.
+// returns NULL if an allocation or thread creation failed
+Chip8_Batch *chip8_batch_create(unsigned int count, unsigned int threads);
+void chip8_batch_destroy(Chip8_Batch *batch);
+
+unsigned int chip8_batch_count(const Chip8_Batch *batch);
+// the machine at `index`, e.g. to load a rom or a snapshot into it
+Chip_8 *chip8_batch_machine(Chip8_Batch *batch, unsigned int index);
+// instructions per 60 Hz timer tick, CYCLES_PER_FRAME by default
+void chip8_batch_set_cycles_per_frame(Chip8_Batch *batch, unsigned int cycles_per_frame);
+// switches every machine to `machine` with its quirk profile, MACHINE_CHIP8 by default. the shared
+// opcode table holds the instructions of one machine, so call it before loading the machines
+void chip8_batch_set_machine(Chip8_Batch *batch, Machine machine);
+// the QUIRK_* flags of every machine, QUIRKS_CHIP8 by default. the shared opcode table is decoded
+// for one set of quirks, so they can't differ between machines
+void chip8_batch_set_quirks(Chip8_Batch *batch, uint8_t quirks);
+
+// runs `cycles` instructions on every machine that isn't halted and returns once all are done
+void chip8_batch_step(Chip8_Batch *batch, unsigned int cycles);
+
+#endif //CHIP_8_BATCH_H
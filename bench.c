@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "chip8.h"
+#include "audio.h"
+
+// measures the core without SDL and prints the results as JSON, so builds can be compared.
+// covers the cost of single opcode classes, whole roms on every engine, expanding the display
+// for the texture upload and filling an audio buffer.
+//
+// usage: chip8_bench [-r rom-dir] [-s scale] [-o file]
+// -r is the directory with the bundled roms (default: the source tree's roms/), -s multiplies the
+// number of iterations, -o writes the JSON to a file instead of stdout
+
+#ifndef ROM_DIR
+#define ROM_DIR "roms"
+#endif
+
+#define OPCODE_CYCLES 4000000 // instructions per opcode class and engine
+#define ROM_CYCLES 4000000 // instructions per rom and engine
+#define RENDER_FRAMES 200000
+#define AUDIO_BUFFERS 20000
+#define AUDIO_SAMPLES 512 // samples per buffer, as requested from SDL by the frontend
+#define BENCH_VERSION 2 // of the JSON, changed when a field changes its meaning
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static const char *engine_names[] = {"interpreter", "cache", "blocks"};
+
+// a loop repeating `body` until the block is full, closed by a jump back. `setup` runs once before
+typedef struct Opcode_Bench {
+    const char *name;
+    uint16_t setup[2];
+    uint16_t body[2]; // 0 terminates early
+    Machine machine;
+} Opcode_Bench;
+
+static const Opcode_Bench opcode_benches[] = {
+        {"8xy4 add",         {0x6003, 0x6105}, {0x8014, 0},      MACHINE_CHIP8},
+        {"8xyN alu mix",     {0x6003, 0x6105}, {0x8014, 0x8016}, MACHINE_CHIP8},
+        {"Dxyn draw",        {0xA000, 0x6108}, {0xD015, 0},      MACHINE_CHIP8},
+        {"Fx33 bcd",         {0xA800, 0x60FF}, {0xF033, 0},      MACHINE_CHIP8},
+        {"Annn+Fx55 store",  {0x60FF, 0},      {0xA800, 0xFF55}, MACHINE_CHIP8},
+        {"Annn+Fx65 load",   {0x60FF, 0},      {0xA800, 0xFF65}, MACHINE_CHIP8},
+        {"00FB+00C1 scroll", {0x00FF, 0},      {0x00FB, 0x00C1}, MACHINE_SCHIP},
+        // F000 nnnn points I above the first 4KB, to a page that holds no code
+        {"F000+Fx33 xo bcd", {0xF000, 0x8200}, {0xF033, 0},      MACHINE_XO_CHIP},
+};
+
+static void put_opcode(Chip_8 *chip, uint16_t address, uint16_t opcode) {
+    chip->memory[address] = opcode >> 8;
+    chip->memory[address + 1] = opcode & 0xFF;
+}
+
+// returns the cost of one instruction in ns, the closing jump included
+static double run_opcode_bench(const Opcode_Bench *bench, Engine *engine, Engine_Type type, unsigned long long cycles) {
+    Chip_8 chip;
+    init_chip(&chip);
+    set_machine(&chip, bench->machine);
+    uint16_t address = 0x200;
+    for (int i = 0; i < 2 && bench->setup[i]; i++, address += 2) put_opcode(&chip, address, bench->setup[i]);
+    uint16_t loop = address;
+    int length = bench->body[1] ? 2 : 1;
+    for (int n = 0; n + length < MAX_BLOCK_LENGTH; n += length) {
+        for (int i = 0; i < length; i++, address += 2) put_opcode(&chip, address, bench->body[i]);
+    }
+    put_opcode(&chip, address, 0x1000 | loop);
+
+    init_engine(engine, type);
+    run_engine(&chip, engine, 10000); // warm up
+    uint64_t start = now_ns();
+    for (unsigned long long done = 0; done < cycles;) done += run_engine(&chip, engine, 100000);
+    return (double) (now_ns() - start) / (double) cycles;
+}
+
+static const char *rom_names[] = {
+        "Pong.ch8",
+        "Tron.ch8",
+        "Tetris [Fran Dachille, 1991].ch8",
+        "Space Invaders [David Winter].ch8",
+        "tests/1-chip8-logo.ch8",
+        "tests/2-ibm-logo.ch8",
+        "tests/3-corax+.ch8",
+        "tests/4-flags.ch8",
+        "tests/5-quirks.ch8",
+        "tests/6-keypad.ch8",
+        "tests/test_opcode.ch8",
+};
+
+// runs a rom for `cycles` in frames of CYCLES_PER_FRAME and returns the instructions executed and the ones
+// skipped in idle loops per second, or -1 if the rom can't be loaded
+static int run_rom_bench(char *path, Engine *engine, Engine_Type type, unsigned long long cycles, double *executed,
+                         double *skipped) {
+    Chip_8 chip;
+    init_chip(&chip);
+    if (load_program_to_memory(&chip, path) == -1) return -1;
+    init_engine(engine, type);
+    uint64_t start = now_ns();
+    unsigned long long done = 0;
+    while (done < cycles && !chip.halted) done += run_frame(&chip, engine, CYCLES_PER_FRAME);
+    double seconds = (double) (now_ns() - start) / 1e9;
+    if (seconds <= 0) seconds = 1e-9;
+    *executed = (double) (done - chip.skipped) / seconds;
+    *skipped = (double) chip.skipped / seconds;
+    return 0;
+}
+
+// returns the cost of expanding one display in ns
+static double run_render_bench(bool hires, unsigned long long frames) {
+    static uint32_t pixels[HIRES_WIDTH * HIRES_HEIGHT];
+    static Display display;
+    display.hires = hires;
+    for (int y = 0; y < HIRES_HEIGHT; y++) {
+        for (int word = 0; word < ROW_WORDS; word++) display.planes[0][y][word] = 0x0F0F3C3C5A5AA5A5ULL << (y & 7);
+    }
+    int height = display_height(&display);
+    uint64_t start = now_ns();
+    for (unsigned long long i = 0; i < frames; i++) {
+        display.planes[0][i % height][0] ^= i; // keep the compiler from hoisting the work
+        expand_display(&display, pixels, display_width(&display) * (int) sizeof(uint32_t));
+    }
+    uint64_t elapsed = now_ns() - start;
+    volatile uint32_t sink = pixels[DISPLAY_WIDTH + 1];
+    (void) sink;
+    return (double) elapsed / (double) frames;
+}
+
+// returns the cost of rendering one buffer of AUDIO_SAMPLES in ns
+static double run_audio_bench(bool use_pattern, unsigned long long buffers) {
+    static Synth synth;
+    static int16_t out[AUDIO_SAMPLES];
+    init_synth(&synth);
+    Tone_Event tone = {0};
+    tone.on = true;
+    tone.use_pattern = use_pattern;
+    tone.pitch = 64;
+    for (int i = 0; i < 16; i++) tone.pattern[i] = (uint8_t) (0xF0 >> (i & 3));
+    queue_tone(&synth, &tone);
+    uint64_t start = now_ns();
+    for (unsigned long long i = 0; i < buffers; i++) render_audio(&synth, out, AUDIO_SAMPLES);
+    uint64_t elapsed = now_ns() - start;
+    volatile int16_t sink = out[AUDIO_SAMPLES / 2];
+    (void) sink;
+    return (double) elapsed / (double) buffers;
+}
+
+int main(int argc, char *argv[]) {
+    const char *rom_dir = ROM_DIR;
+    unsigned long long scale = 1;
+    const char *out_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            printf("usage: chip8_bench [-r rom-dir] [-s scale] [-o file]\n");
+            return -1;
+        }
+        if (strcmp(argv[i], "-r") == 0) rom_dir = argv[++i];
+        else if (strcmp(argv[i], "-s") == 0) scale = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-o") == 0) out_path = argv[++i];
+        else {
+            printf("usage: chip8_bench [-r rom-dir] [-s scale] [-o file]\n");
+            return -1;
+        }
+    }
+    if (scale == 0) scale = 1;
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) return -2;
+
+    static Engine engine;
+    // version 1 reported the roms as instructions_per_second, counting the skipped ones as executed
+    fprintf(out, "{\n  \"version\": %d,\n  \"opcodes\": [", BENCH_VERSION);
+    int entries = 0;
+    for (size_t b = 0; b < sizeof(opcode_benches) / sizeof(opcode_benches[0]); b++) {
+        for (int type = ENGINE_INTERPRETER; type <= ENGINE_BLOCKS; type++) {
+            double ns = run_opcode_bench(&opcode_benches[b], &engine, type, OPCODE_CYCLES * scale);
+            fprintf(out, "%s\n    {\"class\": \"%s\", \"engine\": \"%s\", \"ns_per_instruction\": %.3f}",
+                    entries++ ? "," : "", opcode_benches[b].name, engine_names[type], ns);
+        }
+    }
+
+    fprintf(out, "\n  ],\n  \"roms\": [");
+    entries = 0;
+    for (size_t r = 0; r < sizeof(rom_names) / sizeof(rom_names[0]); r++) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", rom_dir, rom_names[r]);
+        for (int type = ENGINE_INTERPRETER; type <= ENGINE_BLOCKS; type++) {
+            double executed, skipped;
+            if (run_rom_bench(path, &engine, type, ROM_CYCLES * scale, &executed, &skipped) == -1) {
+                fprintf(stderr, "could not load %s\n", path);
+                break;
+            }
+            fprintf(out, "%s\n    {\"rom\": \"%s\", \"engine\": \"%s\", \"executed_per_second\": %.0f, "
+                         "\"skipped_per_second\": %.0f}",
+                    entries++ ? "," : "", rom_names[r], engine_names[type], executed, skipped);
+        }
+    }
+
+    fprintf(out, "\n  ],\n  \"render\": {\"expand_display_ns\": %.1f, \"expand_hires_display_ns\": %.1f},\n",
+            run_render_bench(false, RENDER_FRAMES * scale), run_render_bench(true, RENDER_FRAMES * scale));
+    fprintf(out, "  \"audio\": {\"samples_per_buffer\": %d, \"tone_ns\": %.1f, \"pattern_ns\": %.1f}\n}\n",
+            AUDIO_SAMPLES, run_audio_bench(false, AUDIO_BUFFERS * scale), run_audio_bench(true, AUDIO_BUFFERS * scale));
+    if (out != stdout) fclose(out);
+    return 0;
+}
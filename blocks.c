@@ -0,0 +1,148 @@
+#include <string.h>
+#include "chip8.h"
+#include "trace.h"
+
+// superblock translator: runs of instructions are decoded once into a pool and then executed back
+// to back, without looking up the cache or checking for writes in between. translation follows
+// 1nnn and 2nnn to their target, so loops closed by a jump run as one block
+
+void init_block_cache(Block_Cache *cache) {
+    memset(cache->length, 0, sizeof(cache->length));
+    memset(cache->page_blocks, 0xFF, sizeof(cache->page_blocks));
+    cache->used = 0;
+    cache->links_used = 0;
+}
+
+// drops the blocks covering a page. links of blocks that were translated again since have another first
+static void drop_page(Chip_8 *chip, Block_Cache *cache, unsigned int page) {
+    for (uint16_t i = cache->page_blocks[page]; i != NO_LINK; i = cache->links[i].next) {
+        const Block_Link *link = &cache->links[i];
+        if (cache->first[link->start] == link->first) cache->length[link->start] = 0;
+    }
+    cache->page_blocks[page] = NO_LINK;
+    chip->code_pages[page / 64] &= ~(1ULL << (page & 63));
+}
+
+// drops every block that covers one of the written pages
+static void invalidate_blocks(Chip_8 *chip, Block_Cache *cache) {
+    if (chip->code_dirty & CODE_STALE) {
+        init_block_cache(cache);
+        memset(chip->code_pages, 0, sizeof(chip->code_pages));
+    } else {
+        for (int word = 0; word < CODE_PAGE_WORDS; word++) {
+            uint64_t dirty = chip->dirty_pages[word];
+            while (dirty) {
+                drop_page(chip, cache, word * 64 + __builtin_ctzll(dirty));
+                dirty &= dirty - 1;
+            }
+        }
+    }
+    memset(chip->dirty_pages, 0, sizeof(chip->dirty_pages));
+    chip->code_dirty = 0;
+}
+
+static inline bool pool_full(const Block_Cache *cache) {
+    return cache->used + MAX_BLOCK_LENGTH > BLOCK_POOL_SIZE || cache->links_used + 2 * MAX_BLOCK_LENGTH > BLOCK_LINKS;
+}
+
+// moves the blocks in use to the front of the pool, in order, and drops the links of the others
+static void compact_pool(Block_Cache *cache) {
+    unsigned int used = 0, links_used = 0;
+    memset(cache->page_blocks, 0xFF, sizeof(cache->page_blocks));
+    for (unsigned int i = 0; i < cache->links_used;) {
+        uint16_t start = cache->links[i].start, first = cache->links[i].first;
+        unsigned int end = i + 1;
+        while (end < cache->links_used && cache->links[end].start == start && cache->links[end].first == first) end++;
+        if (cache->length[start] && cache->first[start] == first) {
+            memmove(&cache->pool[used], &cache->pool[first], cache->length[start] * sizeof(Instruction));
+            cache->first[start] = (uint16_t) used;
+            for (unsigned int j = i; j < end; j++) {
+                Block_Link *link = &cache->links[links_used];
+                *link = cache->links[j];
+                link->first = (uint16_t) used;
+                link->next = cache->page_blocks[link->page];
+                cache->page_blocks[link->page] = (uint16_t) links_used++;
+            }
+            used += cache->length[start];
+        }
+        i = end;
+    }
+    cache->used = used;
+    cache->links_used = links_used;
+}
+
+// adds the block being translated to the list of a page. links of the block start at `block_links`,
+// the block is already on the page if the page was linked last by it
+static void link_page(Block_Cache *cache, unsigned int block_links, uint16_t start, unsigned int page) {
+    uint16_t head = cache->page_blocks[page];
+    if (head != NO_LINK && head >= block_links) return;
+    Block_Link *link = &cache->links[cache->links_used];
+    link->start = start;
+    link->first = (uint16_t) cache->used;
+    link->page = (uint16_t) page;
+    link->next = head;
+    cache->page_blocks[page] = (uint16_t) cache->links_used++;
+}
+
+static void translate_block(Chip_8 *chip, Block_Cache *cache, uint16_t start) {
+    // reclaim the dropped blocks once the pool is exhausted, and start over if that frees too little
+    if (pool_full(cache)) {
+        compact_pool(cache);
+        PROFILE_COMPACT(chip->profile);
+        if (cache->used > BLOCK_POOL_SIZE * 3 / 4 || cache->links_used > BLOCK_LINKS * 3 / 4) {
+            init_block_cache(cache);
+            PROFILE_POOL_RESET(chip->profile);
+        }
+    }
+
+    Instruction *first = &cache->pool[cache->used];
+    unsigned int block_links = cache->links_used;
+    uint16_t address = start;
+    unsigned int length = 0;
+    while (length < MAX_BLOCK_LENGTH) {
+        Instruction *in = &first[length++];
+        decode_instruction(fetch_opcode(chip, address), chip->machine, chip->quirks, in);
+        link_page(cache, block_links, start, address >> CODE_PAGE_BITS);
+        link_page(cache, block_links, start, ((address + 1) & chip->address_mask) >> CODE_PAGE_BITS);
+        mark_code_page(chip, address);
+        // a jump to itself ends the block, so its idle loop is skipped right after the first turn
+        if (is_static_jump(in) && in->nnn != address) address = in->nnn;
+        else if (ends_block(in)) break;
+        else address = (address + 2) & chip->address_mask;
+    }
+    cache->first[start] = cache->used;
+    cache->length[start] = length;
+    cache->used += length;
+}
+
+void predecode_block(Chip_8 *chip, Block_Cache *cache, uint16_t start) {
+    if (chip->code_dirty) invalidate_blocks(chip, cache);
+    // filling the pool would start it over and drop the blocks translated so far
+    if (pool_full(cache)) return;
+    if (!cache->length[start]) translate_block(chip, cache, start);
+}
+
+unsigned int run_blocks(Chip_8 *chip, Block_Cache *cache, unsigned int cycles) {
+    unsigned int remaining = cycles;
+    while (remaining && !chip->halted) {
+        if (chip->code_dirty) invalidate_blocks(chip, cache);
+
+        uint16_t start = chip->PC & chip->address_mask;
+        if (!cache->length[start]) translate_block(chip, cache, start);
+
+        // only the last instruction of a block can skip, wait or write memory
+        const Instruction *in = &cache->pool[cache->first[start]];
+        unsigned int length = cache->length[start] < remaining ? cache->length[start] : remaining;
+        const Instruction *end = in + length;
+        for (; in < end; in++) {
+            PROFILE_STEP(chip->profile, chip->PC, in->opcode);
+            TRACE_PC(pc, chip);
+            in->execute(chip, in);
+            TRACE_STEP(chip, pc, in);
+        }
+        chip->opcode = end[-1].opcode;
+        remaining -= length;
+        if (chip->idle) remaining -= skip_idle(chip, remaining);
+    }
+    return cycles - remaining;
+}
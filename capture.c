@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "capture.h"
+
+#define VIDEO_WIDTH HIRES_WIDTH
+#define VIDEO_HEIGHT HIRES_HEIGHT
+#define LUMA_SIZE (VIDEO_WIDTH * VIDEO_HEIGHT)
+#define CHROMA_SIZE (LUMA_SIZE / 4)
+#define PICTURE_SIZE (LUMA_SIZE + 2 * CHROMA_SIZE)
+#define WAV_HEADER_SIZE 44
+
+// grey levels of the palette of expand_display(), full range
+static const uint8_t luma[1 << DISPLAY_PLANES] = {0, 255, 170, 85};
+
+// a slot of the queue, filled in place by the emulation thread
+typedef struct Capture_Frame {
+    Display display;
+    int16_t samples[FRAME_SAMPLES];
+    unsigned int skipped; // frames dropped right before this one
+} Capture_Frame;
+
+struct Capture {
+    FILE *video; // NULL if not recorded
+    FILE *audio;
+    bool wait;
+
+    // emulation thread
+    Synth synth;
+    bool beeping;
+    unsigned int skipped; // frames dropped since the last queued one
+    unsigned long long dropped;
+
+    // the queue, `head` and `tail` only change under `lock`
+    Capture_Frame frames[CAPTURE_QUEUE_SIZE];
+    unsigned int head; // next slot to fill
+    unsigned int tail; // next slot to encode
+    bool closing;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    pthread_cond_t drained;
+    pthread_t thread;
+
+    // encoder thread
+    Display shown; // the display `picture` was converted from
+    uint8_t picture[PICTURE_SIZE];
+    uint32_t audio_bytes;
+    bool failed;
+};
+
+static void put_u16(uint8_t *p, uint16_t value) {
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = (value >> (8 * i)) & 0xFF;
+}
+
+// RIFF header of 16-bit mono PCM, the sizes are filled in once the capture is closed
+static int write_wav_header(FILE *file, uint32_t data_size) {
+    uint8_t header[WAV_HEADER_SIZE];
+    memcpy(header, "RIFF", 4);
+    put_u32(header + 4, WAV_HEADER_SIZE - 8 + data_size);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_u32(header + 16, 16);
+    put_u16(header + 20, 1); // PCM
+    put_u16(header + 22, 1); // mono
+    put_u32(header + 24, AUDIO_RATE);
+    put_u32(header + 28, AUDIO_RATE * 2); // bytes per second
+    put_u16(header + 32, 2); // bytes per sample
+    put_u16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    put_u32(header + 40, data_size);
+    return fwrite(header, sizeof(header), 1, file) == 1 ? 0 : -1;
+}
+
+// converts the changed rows of the display into the luma plane, low resolution pixels cover 2x2 pixels
+static void update_picture(Capture *capture, const Display *display) {
+    Dirty_Region changed = {0};
+    Dirty_Rect rect;
+    diff_display(&capture->shown, display, &changed);
+    if (!dirty_rect(&changed, display, &rect)) return;
+    int scale = display->hires ? 1 : 2;
+    for (int y = rect.y; y < rect.y + rect.height; y++) {
+        uint8_t *row = &capture->picture[y * scale * VIDEO_WIDTH];
+        for (int x = 0; x < display_width(display); x++) {
+            uint8_t level = luma[get_pixel(display, x, y)];
+            for (int i = 0; i < scale; i++) row[x * scale + i] = level;
+        }
+        if (scale == 2) memcpy(row + VIDEO_WIDTH, row, VIDEO_WIDTH);
+    }
+    memcpy(&capture->shown, display, sizeof(capture->shown));
+}
+
+static void write_picture(Capture *capture) {
+    if (!capture->video) return;
+    if (fputs("FRAME\n", capture->video) == EOF ||
+        fwrite(capture->picture, sizeof(capture->picture), 1, capture->video) != 1)
+        capture->failed = true;
+}
+
+static void write_samples(Capture *capture, const int16_t *samples) {
+    if (!capture->audio) return;
+    uint8_t bytes[FRAME_SAMPLES * 2];
+    for (int i = 0; i < FRAME_SAMPLES; i++) put_u16(&bytes[i * 2], (uint16_t) samples[i]);
+    if (fwrite(bytes, sizeof(bytes), 1, capture->audio) != 1) capture->failed = true;
+    capture->audio_bytes += sizeof(bytes);
+}
+
+static void encode_frame(Capture *capture, const Capture_Frame *frame) {
+    // dropped frames repeat the last picture with silence, so the length matches the emulated time
+    static const int16_t silence[FRAME_SAMPLES];
+    for (unsigned int i = 0; i < frame->skipped; i++) {
+        write_picture(capture);
+        write_samples(capture, silence);
+    }
+    update_picture(capture, &frame->display);
+    write_picture(capture);
+    write_samples(capture, frame->samples);
+}
+
+static void *encoder_thread(void *data) {
+    Capture *capture = data;
+    pthread_mutex_lock(&capture->lock);
+    for (;;) {
+        while (capture->head == capture->tail && !capture->closing) pthread_cond_wait(&capture->filled, &capture->lock);
+        if (capture->head == capture->tail) break;
+        unsigned int tail = capture->tail;
+        // the slot stays owned by the encoder until `tail` moves past it
+        pthread_mutex_unlock(&capture->lock);
+        encode_frame(capture, &capture->frames[tail % CAPTURE_QUEUE_SIZE]);
+        pthread_mutex_lock(&capture->lock);
+        capture->tail = tail + 1;
+        pthread_cond_signal(&capture->drained);
+    }
+    pthread_mutex_unlock(&capture->lock);
+    return NULL;
+}
+
+Capture *open_capture(const char *video_path, const char *audio_path, bool wait) {
+    Capture *capture = calloc(1, sizeof(Capture));
+    if (!capture) return NULL;
+    capture->wait = wait;
+    init_synth(&capture->synth);
+    memset(capture->picture + LUMA_SIZE, 128, 2 * CHROMA_SIZE); // no colour
+
+    if (video_path) {
+        capture->video = fopen(video_path, "wb");
+        if (!capture->video || fprintf(capture->video, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+                                       VIDEO_WIDTH, VIDEO_HEIGHT, TIMER_HZ) < 0)
+            goto fail;
+    }
+    if (audio_path) {
+        capture->audio = fopen(audio_path, "wb");
+        if (!capture->audio || write_wav_header(capture->audio, 0) == -1) goto fail;
+    }
+
+    pthread_mutex_init(&capture->lock, NULL);
+    pthread_cond_init(&capture->filled, NULL);
+    pthread_cond_init(&capture->drained, NULL);
+    if (pthread_create(&capture->thread, NULL, encoder_thread, capture) != 0) {
+        pthread_mutex_destroy(&capture->lock);
+        pthread_cond_destroy(&capture->filled);
+        pthread_cond_destroy(&capture->drained);
+        goto fail;
+    }
+    return capture;
+
+fail:
+    if (capture->video) fclose(capture->video);
+    if (capture->audio) fclose(capture->audio);
+    free(capture);
+    return NULL;
+}
+
+int close_capture(Capture *capture) {
+    pthread_mutex_lock(&capture->lock);
+    capture->closing = true;
+    pthread_cond_signal(&capture->filled);
+    pthread_mutex_unlock(&capture->lock);
+    pthread_join(capture->thread, NULL);
+
+    // frames dropped at the very end still count towards the length
+    if (capture->skipped) {
+        Capture_Frame *last = &capture->frames[0];
+        memcpy(&last->display, &capture->shown, sizeof(last->display));
+        memset(last->samples, 0, sizeof(last->samples));
+        last->skipped = capture->skipped - 1;
+        encode_frame(capture, last);
+    }
+
+    if (capture->video && fclose(capture->video) != 0) capture->failed = true;
+    if (capture->audio) {
+        if (fseek(capture->audio, 0, SEEK_SET) != 0 || write_wav_header(capture->audio, capture->audio_bytes) == -1)
+            capture->failed = true;
+        if (fclose(capture->audio) != 0) capture->failed = true;
+    }
+    pthread_mutex_destroy(&capture->lock);
+    pthread_cond_destroy(&capture->filled);
+    pthread_cond_destroy(&capture->drained);
+    int result = capture->failed ? -1 : 0;
+    free(capture);
+    return result;
+}
+
+unsigned long long capture_dropped(const Capture *capture) {
+    return capture->dropped;
+}
+
+bool capture_frame(Capture *capture, const Chip_8 *chip, uint64_t frame) {
+    update_tone(&capture->synth, chip, frame, &capture->beeping);
+
+    pthread_mutex_lock(&capture->lock);
+    while (capture->head - capture->tail == CAPTURE_QUEUE_SIZE && capture->wait)
+        pthread_cond_wait(&capture->drained, &capture->lock);
+    bool full = capture->head - capture->tail == CAPTURE_QUEUE_SIZE;
+    unsigned int head = capture->head;
+    pthread_mutex_unlock(&capture->lock);
+
+    if (full) {
+        // the tone still has to advance through the dropped frame
+        int16_t samples[FRAME_SAMPLES];
+        render_audio(&capture->synth, samples, FRAME_SAMPLES);
+        capture->skipped++;
+        capture->dropped++;
+        return false;
+    }
+
+    // the slot at `head` isn't visible to the encoder until `head` moves past it
+    Capture_Frame *slot = &capture->frames[head % CAPTURE_QUEUE_SIZE];
+    memcpy(&slot->display, &chip->display, sizeof(slot->display));
+    render_audio(&capture->synth, slot->samples, FRAME_SAMPLES);
+    slot->skipped = capture->skipped;
+    capture->skipped = 0;
+
+    pthread_mutex_lock(&capture->lock);
+    capture->head = head + 1;
+    pthread_cond_signal(&capture->filled);
+    pthread_mutex_unlock(&capture->lock);
+    return true;
+}
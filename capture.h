@@ -0,0 +1,35 @@
+#ifndef CHIP_8_CAPTURE_H
+#define CHIP_8_CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "chip8.h"
+#include "audio.h"
+
+// records the display and the sound of every emulated 60 Hz frame to a Y4M video and a WAV file.
+// the emulation thread fills a slot of a bounded queue in place and an encoder thread writes it out,
+// so emulation never waits for the disk.
+//
+// the video is 128x64 grey 4:2:0 (C420jpeg) at 60 fps, low resolution pixels are doubled. the audio
+// is the tone of the machine as 16-bit mono PCM at AUDIO_RATE, synthesized independently of the
+// audio device so it stays in step with the video
+
+#define CAPTURE_QUEUE_SIZE 64 // frames, about a second of emulation
+
+typedef struct Capture Capture;
+
+// starts the encoder thread, either path may be NULL. with `wait` the emulation waits for the encoder
+// when the queue is full, as headless runs do. without it the frame is dropped and the encoder repeats
+// the previous one with silence, keeping the recording in step with real time.
+// returns NULL if a file can't be created or the thread can't be started
+Capture *open_capture(const char *video_path, const char *audio_path, bool wait);
+// flushes the queue and finishes the files. returns -1 if a write failed
+int close_capture(Capture *capture);
+// dropped frames so far
+unsigned long long capture_dropped(const Capture *capture);
+
+// captures the frame `chip` just finished, call it after every frame with the number of frames run so
+// far and before chip->audio_flag is cleared. returns false if the frame was dropped
+bool capture_frame(Capture *capture, const Chip_8 *chip, uint64_t frame);
+
+#endif //CHIP_8_CAPTURE_H
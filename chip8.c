@@ -0,0 +1,1174 @@
+#include <stdio.h>
+#include <string.h>
+#include "chip8.h"
+#include "trace.h"
+
+void initialise_key_states(Chip_8 *chip) {
+    for (int i = 0; i < 16; i++) {
+        chip->key[i] = 0;
+    }
+}
+
+void init_chip(Chip_8 *chip) {
+    // initialise variables, the chip is owned by the caller
+    memset(chip, 0, sizeof(*chip));
+    chip->opcode = 0;
+    chip->I = 0;
+    chip->SP = 0;
+    chip->PC = 0x200; // 0x200 is where the program is loaded to
+    chip->draw_flag = false;
+    chip->key_pressed = false;
+    memset(chip->memory, 0, sizeof(chip->memory));
+    chip->code_dirty = CODE_STALE; // the engine may hold instructions of a previous program
+    chip->rng = RNG_SEED;
+    chip->vblank = true;
+
+    initialise_key_states(chip);
+
+    // load font-set
+    unsigned char font_set[80] =
+            {
+                    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+                    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+                    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+                    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+                    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+                    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+                    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+                    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+                    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+                    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+                    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+                    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+                    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+                    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+                    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+                    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+            };
+    for (int i = 0; i < 80; i++)
+        chip->memory[FONT_ADDRESS + i] = font_set[i]; // loaded into beginning of memory
+
+    // 8x10 digits of SCHIP, A to F as on XO-CHIP
+    static const uint8_t hires_font_set[160] = {
+            0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+            0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+            0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+            0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+            0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+            0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+            0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+            0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+            0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+            0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+            0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+            0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+    };
+    memcpy(&chip->memory[HIRES_FONT_ADDRESS], hires_font_set, sizeof(hires_font_set));
+
+    chip->pitch = 64; // 4000 Hz
+    set_machine(chip, MACHINE_CHIP8);
+}
+
+void set_machine(Chip_8 *chip, Machine machine) {
+    chip->machine = machine;
+    chip->address_mask = address_mask(machine);
+    memset(&chip->display, 0, sizeof(chip->display));
+    chip->plane_mask = 1;
+    chip->draw_flag = true;
+    mark_display_dirty(chip);
+    set_quirks(chip, machine_quirks(machine));
+}
+
+void set_quirks(Chip_8 *chip, uint8_t quirks) {
+    chip->quirks = quirks;
+    chip->code_dirty |= CODE_STALE; // decoded instructions use the handlers of the old quirks
+}
+
+typedef struct Quirk_Name {
+    const char *name;
+    uint8_t quirks;
+    bool profile; // replaces the quirks instead of adding to them
+} Quirk_Name;
+
+static const Quirk_Name quirk_names[] = {
+        {"chip8",    QUIRKS_CHIP8,   true},
+        {"vip",      QUIRKS_VIP,     true},
+        {"schip",    QUIRKS_SCHIP,   true},
+        {"xo",       QUIRKS_XO_CHIP, true},
+        {"clip",     QUIRK_CLIP,     false},
+        {"shift",    QUIRK_SHIFT,    false},
+        {"keep-i",   QUIRK_KEEP_I,   false},
+        {"jump-vx",  QUIRK_JUMP_VX,  false},
+        {"vf-reset", QUIRK_VF_RESET, false},
+        {"display-wait", QUIRK_DISPLAY_WAIT, false},
+};
+
+int parse_quirks(const char *names, uint8_t *quirks) {
+    uint8_t parsed = *quirks;
+    while (*names) {
+        size_t length = strcspn(names, ",");
+        const Quirk_Name *match = NULL;
+        for (size_t i = 0; i < sizeof(quirk_names) / sizeof(quirk_names[0]) && !match; i++) {
+            if (strlen(quirk_names[i].name) == length && strncmp(quirk_names[i].name, names, length) == 0)
+                match = &quirk_names[i];
+        }
+        if (!match) return -1;
+        parsed = match->profile ? match->quirks : parsed | match->quirks;
+        names += length;
+        if (*names == ',') names++;
+    }
+    *quirks = parsed;
+    return 0;
+}
+
+Machine machine_from_path(const char *path) {
+    const char *extension = strrchr(path, '.');
+    if (extension && strcmp(extension, ".sc8") == 0) return MACHINE_SCHIP;
+    if (extension && strcmp(extension, ".xo8") == 0) return MACHINE_XO_CHIP;
+    return MACHINE_CHIP8;
+}
+
+// open rom file and load into memory array (at index 512)
+int load_program_to_memory(Chip_8 *chip, char *path) {
+    FILE *file = fopen(path, "rb"); // it took me quite a while to figure out you need to use 'rb'
+    if (!file) return -1;
+    size_t capacity = chip->address_mask + 1u - 512;
+    size_t read = fread(&chip->memory[512], 1, capacity, file);
+    bool truncated = read == capacity && fgetc(file) != EOF;
+    fclose(file);
+    if (read == 0 || truncated) return -1;
+    chip->code_dirty |= CODE_STALE;
+    return (int) read;
+}
+
+int load_program(Chip_8 *chip, const uint8_t *data, size_t size) {
+    if (size == 0 || size > chip->address_mask + 1u - 512) return -1;
+    memcpy(&chip->memory[512], data, size);
+    chip->code_dirty |= CODE_STALE;
+    return 0;
+}
+
+// marks one row of pixels, `line` has the changed pixels set
+static inline void mark_row_dirty(Chip_8 *chip, unsigned int row, const uint64_t line[ROW_WORDS]) {
+    if (!(line[0] | line[1])) return;
+    chip->dirty.rows |= 1ULL << row;
+    chip->dirty.columns[0] |= line[0];
+    chip->dirty.columns[1] |= line[1];
+}
+
+// clears the selected planes
+void clear_display(Chip_8 *chip) {
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!(chip->plane_mask & (1 << plane))) continue;
+        // only set pixels change, clearing an empty screen before redrawing it marks nothing
+        for (int y = 0; y < HIRES_HEIGHT; y++) mark_row_dirty(chip, y, chip->display.planes[plane][y]);
+        memset(chip->display.planes[plane], 0, sizeof(chip->display.planes[plane]));
+    }
+}
+
+void mark_display_dirty(Chip_8 *chip) {
+    chip->dirty.rows = ~0ULL;
+    for (int word = 0; word < ROW_WORDS; word++) chip->dirty.columns[word] = ~0ULL;
+}
+
+void take_dirty(Chip_8 *chip, Dirty_Region *region) {
+    region->rows |= chip->dirty.rows;
+    for (int word = 0; word < ROW_WORDS; word++) region->columns[word] |= chip->dirty.columns[word];
+    memset(&chip->dirty, 0, sizeof(chip->dirty));
+}
+
+void diff_display(const Display *a, const Display *b, Dirty_Region *region) {
+    if (a->hires != b->hires) {
+        region->rows = ~0ULL;
+        for (int word = 0; word < ROW_WORDS; word++) region->columns[word] = ~0ULL;
+        return;
+    }
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        for (int y = 0; y < display_height(a); y++) {
+            uint64_t changed = 0;
+            for (int word = 0; word < ROW_WORDS; word++) {
+                uint64_t diff = a->planes[plane][y][word] ^ b->planes[plane][y][word];
+                region->columns[word] |= diff;
+                changed |= diff;
+            }
+            if (changed) region->rows |= 1ULL << y;
+        }
+    }
+}
+
+bool display_changed(const Dirty_Region *region, const Display *a, const Display *b) {
+    if (a->hires != b->hires) return true;
+    uint64_t rows = region->rows;
+    while (rows) {
+        int y = __builtin_ctzll(rows);
+        rows &= rows - 1;
+        for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+            for (int word = 0; word < ROW_WORDS; word++) {
+                if ((a->planes[plane][y][word] ^ b->planes[plane][y][word]) & region->columns[word]) return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool dirty_rect(const Dirty_Region *region, const Display *display, Dirty_Rect *rect) {
+    int height = display_height(display);
+    uint64_t rows = height < 64 ? region->rows & ((1ULL << height) - 1) : region->rows;
+    // columns past the visible width are only used in high resolution
+    uint64_t right = display->hires ? region->columns[1] : 0;
+    uint64_t left = region->columns[0];
+    if (!rows || !(left | right)) return false;
+    rect->y = __builtin_ctzll(rows);
+    rect->height = 64 - __builtin_clzll(rows) - rect->y;
+    // the most significant bit is the left-most pixel
+    rect->x = left ? __builtin_clzll(left) : 64 + __builtin_clzll(right);
+    int end = right ? 128 - __builtin_ctzll(right) : 64 - __builtin_ctzll(left);
+    rect->width = end - rect->x;
+    return true;
+}
+
+// writes a byte to memory. a page the engine decoded instructions from is marked dirty so they get
+// invalidated, stores to data pages cost nothing more
+static inline void write_memory(Chip_8 *chip, uint16_t address, uint8_t value) {
+    address &= chip->address_mask;
+    chip->memory[address] = value;
+    unsigned int page = address >> CODE_PAGE_BITS;
+    uint64_t bit = 1ULL << (page & 63);
+    if (chip->code_pages[page / 64] & bit) {
+        chip->dirty_pages[page / 64] |= bit;
+        chip->code_dirty |= CODE_WRITTEN;
+    }
+}
+
+// xorshift32, kept in the chip so runs can be snapshotted and reproduced
+static inline uint8_t next_random(Chip_8 *chip) {
+    uint32_t x = chip->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    chip->rng = x;
+    return x >> 24;
+}
+
+// ---opcode handlers---
+// every handler gets the instruction with x, y, n, kk and nnn already extracted from the opcode.
+// instructions with quirks have a handler per setting, sharing an inline body with the setting as constant
+
+// frontends report the opcode, printing here would stall the hot loop
+static void op_unknown(Chip_8 *chip, const Instruction *in) {
+    chip->opcode = in->opcode;
+    chip->halted = true;
+    chip->halt_reason = HALT_UNKNOWN_OPCODE;
+}
+
+static void op_cls(Chip_8 *chip, const Instruction *in) { // 00E0: clears the screen
+    (void) in;
+    clear_display(chip);
+    chip->draw_flag = true;
+    chip->PC += 2;
+}
+
+static void op_scroll_down(Chip_8 *chip, const Instruction *in) { // 00Cn: scroll the selected planes down n rows
+    Display *display = &chip->display;
+    unsigned int height = display_height(display);
+    unsigned int n = in->n < height ? in->n : height;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!(chip->plane_mask & (1 << plane))) continue;
+        uint64_t (*rows)[ROW_WORDS] = display->planes[plane];
+        memmove(rows[n], rows[0], (height - n) * sizeof(rows[0]));
+        memset(rows[0], 0, n * sizeof(rows[0]));
+    }
+    mark_display_dirty(chip);
+    chip->draw_flag = true;
+    chip->PC += 2;
+}
+
+static void op_scroll_up(Chip_8 *chip, const Instruction *in) { // 00Dn: scroll the selected planes up n rows
+    Display *display = &chip->display;
+    unsigned int height = display_height(display);
+    unsigned int n = in->n < height ? in->n : height;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!(chip->plane_mask & (1 << plane))) continue;
+        uint64_t (*rows)[ROW_WORDS] = display->planes[plane];
+        memmove(rows[0], rows[n], (height - n) * sizeof(rows[0]));
+        memset(rows[height - n], 0, n * sizeof(rows[0]));
+    }
+    mark_display_dirty(chip);
+    chip->draw_flag = true;
+    chip->PC += 2;
+}
+
+static void op_scroll_right(Chip_8 *chip, const Instruction *in) { // 00FB: scroll the selected planes right 4 pixels
+    (void) in;
+    Display *display = &chip->display;
+    int height = display_height(display);
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!(chip->plane_mask & (1 << plane))) continue;
+        for (int y = 0; y < height; y++) {
+            uint64_t *row = display->planes[plane][y];
+            if (display->hires) row[1] = row[1] >> 4 | row[0] << 60;
+            row[0] >>= 4;
+        }
+    }
+    mark_display_dirty(chip);
+    chip->draw_flag = true;
+    chip->PC += 2;
+}
+
+static void op_scroll_left(Chip_8 *chip, const Instruction *in) { // 00FC: scroll the selected planes left 4 pixels
+    (void) in;
+    Display *display = &chip->display;
+    int height = display_height(display);
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!(chip->plane_mask & (1 << plane))) continue;
+        for (int y = 0; y < height; y++) {
+            uint64_t *row = display->planes[plane][y];
+            if (display->hires) {
+                row[0] = row[0] << 4 | row[1] >> 60;
+                row[1] <<= 4;
+            } else row[0] <<= 4;
+        }
+    }
+    mark_display_dirty(chip);
+    chip->draw_flag = true;
+    chip->PC += 2;
+}
+
+static void op_exit(Chip_8 *chip, const Instruction *in) { // 00FD: exit the interpreter
+    chip->opcode = in->opcode;
+    chip->halted = true;
+    chip->halt_reason = HALT_EXIT;
+}
+
+static void op_lores(Chip_8 *chip, const Instruction *in) { // 00FE: switch to 64x32 and clear the screen
+    (void) in;
+    chip->display.hires = false;
+    memset(chip->display.planes, 0, sizeof(chip->display.planes));
+    mark_display_dirty(chip);
+    chip->draw_flag = true;
+    chip->PC += 2;
+}
+
+static void op_hires(Chip_8 *chip, const Instruction *in) { // 00FF: switch to 128x64 and clear the screen
+    (void) in;
+    chip->display.hires = true;
+    memset(chip->display.planes, 0, sizeof(chip->display.planes));
+    mark_display_dirty(chip);
+    chip->draw_flag = true;
+    chip->PC += 2;
+}
+
+static void op_ret(Chip_8 *chip, const Instruction *in) { // 00EE: returns from subroutine
+    if (chip->SP == 0) {
+        chip->opcode = in->opcode;
+        chip->halted = true;
+        chip->halt_reason = HALT_STACK_UNDERFLOW;
+        return;
+    }
+    chip->SP--;
+    chip->PC = chip->stack[chip->SP];
+    chip->PC += 2;
+}
+
+static void op_jp(Chip_8 *chip, const Instruction *in) { // 1nnn: jump to nnn (address)
+    // a jump to itself ends many programs, it spins until the machine is stopped
+    if (in->nnn == chip->PC) chip->idle = 1;
+    chip->PC = in->nnn;
+}
+
+static void op_call(Chip_8 *chip, const Instruction *in) { // 2nnn: call subroutine at nnn
+    if (chip->SP == STACK_SIZE) {
+        chip->opcode = in->opcode;
+        chip->halted = true;
+        chip->halt_reason = HALT_STACK_OVERFLOW;
+        return;
+    }
+    chip->stack[chip->SP] = chip->PC;
+    chip->SP++;
+    chip->PC = in->nnn;
+}
+
+// skips the next instruction, on XO-CHIP F000 nnnn is skipped as a whole
+static inline void skip_next(Chip_8 *chip) {
+    chip->PC += chip->machine == MACHINE_XO_CHIP && fetch_opcode(chip, chip->PC + 2) == 0xF000 ? 6 : 4;
+}
+
+static void op_se_byte(Chip_8 *chip, const Instruction *in) { // 3xkk: skip next instruction if V[x] == kk
+    if (chip->V[in->x] == in->kk) skip_next(chip);
+    else chip->PC += 2;
+}
+
+static void op_sne_byte(Chip_8 *chip, const Instruction *in) { // 4xkk: skip next instruction if V[x] != kk
+    if (chip->V[in->x] != in->kk) skip_next(chip);
+    else chip->PC += 2;
+}
+
+static void op_se_reg(Chip_8 *chip, const Instruction *in) { // 5xy0: skip next instruction if V[x] == V[y]
+    if (chip->V[in->x] == chip->V[in->y]) skip_next(chip);
+    else chip->PC += 2;
+}
+
+static void op_save_range(Chip_8 *chip, const Instruction *in) { // 5xy2: store Vx...Vy in memory at I, I is kept
+    int step = in->x <= in->y ? 1 : -1;
+    for (int i = 0, r = in->x;; i++, r += step) {
+        write_memory(chip, chip->I + i, chip->V[r]);
+        if (r == in->y) break;
+    }
+    chip->PC += 2;
+}
+
+static void op_load_range(Chip_8 *chip, const Instruction *in) { // 5xy3: load Vx...Vy from memory at I, I is kept
+    int step = in->x <= in->y ? 1 : -1;
+    for (int i = 0, r = in->x;; i++, r += step) {
+        chip->V[r] = chip->memory[(chip->I + i) & chip->address_mask];
+        if (r == in->y) break;
+    }
+    chip->PC += 2;
+}
+
+static void op_ld_byte(Chip_8 *chip, const Instruction *in) { // 6xkk: set V[x] to kk (byte)
+    chip->V[in->x] = in->kk;
+    chip->PC += 2;
+}
+
+static void op_add_byte(Chip_8 *chip, const Instruction *in) { // 7xkk: add kk to V[x]
+    chip->V[in->x] += in->kk;
+    chip->PC += 2;
+}
+
+static void op_ld_reg(Chip_8 *chip, const Instruction *in) { // 8xy0: set Vx = Vy
+    chip->V[in->x] = chip->V[in->y];
+    chip->PC += 2;
+}
+
+static void op_or(Chip_8 *chip, const Instruction *in) { // 8xy1: set Vx = Vx OR Vy
+    chip->V[in->x] |= chip->V[in->y];
+    chip->PC += 2;
+}
+
+static void op_and(Chip_8 *chip, const Instruction *in) { // 8xy2: set Vx = Vx AND Vy
+    chip->V[in->x] &= chip->V[in->y];
+    chip->PC += 2;
+}
+
+static void op_xor(Chip_8 *chip, const Instruction *in) { // 8xy3: set Vx = Vx XOR Vy
+    chip->V[in->x] ^= chip->V[in->y];
+    chip->PC += 2;
+}
+
+// QUIRK_VF_RESET: the VIP interpreter runs the logic operations through a routine that clobbers VF
+static void op_or_vf_reset(Chip_8 *chip, const Instruction *in) {
+    op_or(chip, in);
+    chip->V[0xF] = 0;
+}
+
+static void op_and_vf_reset(Chip_8 *chip, const Instruction *in) {
+    op_and(chip, in);
+    chip->V[0xF] = 0;
+}
+
+static void op_xor_vf_reset(Chip_8 *chip, const Instruction *in) {
+    op_xor(chip, in);
+    chip->V[0xF] = 0;
+}
+
+static void op_add_reg(Chip_8 *chip, const Instruction *in) { // 8xy4: set Vx = Vx + Vy, VF = carry
+    int Vx = chip->V[in->x];
+    chip->V[in->x] += chip->V[in->y];
+    chip->V[0xF] = chip->V[in->y] + Vx > 255 ? 1 : 0;
+    chip->PC += 2;
+}
+
+static void op_sub(Chip_8 *chip, const Instruction *in) { // 8xy5: set Vx = Vx - Vy, VF = 1 if not borrowed
+    int Vx = chip->V[in->x];
+    chip->V[in->x] -= chip->V[in->y];
+    chip->V[0xF] = Vx >= chip->V[in->y] ? 1 : 0;
+    chip->PC += 2;
+}
+
+static inline void shift_right(Chip_8 *chip, const Instruction *in, uint8_t value) {
+    chip->V[in->x] = value >> 1;
+    chip->V[0xF] = value & 0x1;
+    chip->PC += 2;
+}
+
+static void op_shr(Chip_8 *chip, const Instruction *in) { // 8xy6: set Vx = Vy >> 1, VF = LSB
+    shift_right(chip, in, chip->V[in->y]);
+}
+
+static void op_shr_vx(Chip_8 *chip, const Instruction *in) { // 8xy6 with QUIRK_SHIFT: set Vx = Vx >> 1
+    shift_right(chip, in, chip->V[in->x]);
+}
+
+static void op_subn(Chip_8 *chip, const Instruction *in) { // 8xy7: set Vx = Vy - Vx, VF = 1 if not borrowed
+    int Vx = chip->V[in->x];
+    chip->V[in->x] = chip->V[in->y] - chip->V[in->x];
+    chip->V[0xF] = chip->V[in->y] >= Vx ? 1 : 0;
+    chip->PC += 2;
+}
+
+static inline void shift_left(Chip_8 *chip, const Instruction *in, uint8_t value) {
+    chip->V[in->x] = value << 1;
+    chip->V[0xF] = (value >> 7) & 0x1;
+    chip->PC += 2;
+}
+
+static void op_shl(Chip_8 *chip, const Instruction *in) { // 8xyE: set Vx = Vy << 1, VF = MSB
+    shift_left(chip, in, chip->V[in->y]);
+}
+
+static void op_shl_vx(Chip_8 *chip, const Instruction *in) { // 8xyE with QUIRK_SHIFT: set Vx = Vx << 1
+    shift_left(chip, in, chip->V[in->x]);
+}
+
+static void op_sne_reg(Chip_8 *chip, const Instruction *in) { // 9xy0: skip next instruction if Vx != Vy
+    if (chip->V[in->x] != chip->V[in->y]) skip_next(chip);
+    else chip->PC += 2;
+}
+
+static void op_ld_i(Chip_8 *chip, const Instruction *in) { // Annn: set I to nnn (address)
+    chip->I = in->nnn;
+    chip->PC += 2;
+}
+
+static void op_jp_v0(Chip_8 *chip, const Instruction *in) { // Bnnn: jump to nnn + V0
+    chip->PC = in->nnn + chip->V[0];
+}
+
+static void op_jp_vx(Chip_8 *chip, const Instruction *in) { // Bxnn with QUIRK_JUMP_VX: jump to xnn + Vx
+    chip->PC = in->nnn + chip->V[in->x];
+}
+
+static void op_rnd(Chip_8 *chip, const Instruction *in) { // Cxkk: set Vx = random byte & kk
+    chip->V[in->x] = in->kk & next_random(chip);
+    chip->PC += 2;
+}
+
+// shifts a sprite row of up to 16 pixels, left-aligned in `sprite`, to column x of a display row.
+// pixels past the right edge wrap around or get clipped
+static inline void place_sprite_row(uint64_t sprite, unsigned int x, bool hires, bool clip, uint64_t line[ROW_WORDS]) {
+    if (!hires) {
+        line[0] = sprite >> x;
+        if (!clip && x) line[0] |= sprite << (64 - x);
+        line[1] = 0;
+    } else if (x < 64) {
+        line[0] = sprite >> x;
+        line[1] = x ? sprite << (64 - x) : 0;
+    } else {
+        line[0] = !clip && x > 64 ? sprite << (128 - x) : 0;
+        line[1] = sprite >> (x - 64);
+    }
+}
+
+// Dxyn of CHIP-8 programs: 8 pixel wide sprites on the first plane in low resolution
+static inline void draw_lores_sprite(Chip_8 *chip, const Instruction *in, bool clip) {
+    // the start position wraps around the screen
+    unsigned int x = chip->V[in->x] % DISPLAY_WIDTH;
+    unsigned int y = chip->V[in->y] % DISPLAY_HEIGHT;
+    uint64_t collision = 0;
+    uint64_t rows = 0, columns = 0; // dirty pixels
+
+    for (unsigned int yline = 0; yline < in->n; yline++) {
+        unsigned int row = y + yline;
+        if (row >= DISPLAY_HEIGHT) {
+            if (clip) break;
+            row -= DISPLAY_HEIGHT;
+        }
+        // the sprite byte is shifted into place as one row, pixels past the right edge wrap or get clipped
+        uint64_t sprite = (uint64_t) chip->memory[(chip->I + yline) & chip->address_mask] << 56;
+        uint64_t line = sprite >> x;
+        if (!clip && x) line |= sprite << (64 - x);
+
+        uint64_t *pixels = &chip->display.planes[0][row][0];
+        collision |= *pixels & line;
+        *pixels ^= line;
+        rows |= (uint64_t) (line != 0) << row;
+        columns |= line;
+    }
+
+    chip->dirty.rows |= rows;
+    chip->dirty.columns[0] |= columns;
+    chip->V[0xF] = collision != 0;
+    PROFILE_DRAW(chip->profile, collision != 0);
+    chip->draw_flag = true;
+    chip->PC += 2;
+}
+
+static inline void draw_sprite(Chip_8 *chip, const Instruction *in, bool clip) {
+    if (!chip->display.hires && chip->plane_mask == 1 && in->n) {
+        draw_lores_sprite(chip, in, clip);
+        return;
+    }
+    Display *display = &chip->display;
+    unsigned int width = display_width(display);
+    unsigned int height = display_height(display);
+    // the start position wraps around the screen
+    unsigned int x = chip->V[in->x] % width;
+    unsigned int y = chip->V[in->y] % height;
+    // Dxy0 draws a 16x16 sprite of two bytes per row on SCHIP and XO-CHIP
+    bool wide = in->n == 0 && chip->machine != MACHINE_CHIP8;
+    unsigned int rows = wide ? 16 : in->n;
+    unsigned int bytes = wide ? 2 : 1;
+    uint16_t address = chip->I;
+    uint64_t collision = 0;
+
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (!(chip->plane_mask & (1 << plane))) continue;
+        for (unsigned int yline = 0; yline < rows; yline++) {
+            unsigned int row = y + yline;
+            if (row >= height) {
+                if (clip) break;
+                row -= height;
+            }
+            uint16_t source = address + yline * bytes;
+            uint64_t sprite = (uint64_t) chip->memory[source & chip->address_mask] << 56;
+            if (wide) sprite |= (uint64_t) chip->memory[(source + 1) & chip->address_mask] << 48;
+            uint64_t line[ROW_WORDS];
+            place_sprite_row(sprite, x, display->hires, clip, line);
+
+            uint64_t *pixels = display->planes[plane][row];
+            collision |= (pixels[0] & line[0]) | (pixels[1] & line[1]);
+            pixels[0] ^= line[0];
+            pixels[1] ^= line[1];
+            mark_row_dirty(chip, row, line);
+        }
+        // with both planes selected the sprite of the second plane follows the first one
+        address += rows * bytes;
+    }
+
+    chip->V[0xF] = collision != 0;
+    PROFILE_DRAW(chip->profile, collision != 0);
+    chip->draw_flag = true;
+    chip->PC += 2;
+}
+
+static void op_drw(Chip_8 *chip, const Instruction *in) { // Dxyn: display n-byte sprite, starting at I
+    draw_sprite(chip, in, false);
+}
+
+static void op_drw_clip(Chip_8 *chip, const Instruction *in) { // Dxyn with QUIRK_CLIP
+    draw_sprite(chip, in, true);
+}
+
+// QUIRK_DISPLAY_WAIT: the VIP draws right after the vertical blank interrupt. until the next frame
+// starts the instruction repeats, like Fx0A waiting for a key
+static void op_drw_wait(Chip_8 *chip, const Instruction *in) {
+    if (!chip->vblank) {
+        chip->idle = 1;
+        return;
+    }
+    chip->vblank = false;
+    draw_sprite(chip, in, false);
+}
+
+static void op_drw_clip_wait(Chip_8 *chip, const Instruction *in) {
+    if (!chip->vblank) {
+        chip->idle = 1;
+        return;
+    }
+    chip->vblank = false;
+    draw_sprite(chip, in, true);
+}
+
+static void op_skp(Chip_8 *chip, const Instruction *in) { // Ex9E: skip next instruction if key Vx is pressed
+    if (chip->key[chip->V[in->x] & 0xF] != 0) {
+        chip->key_pressed = true;
+        skip_next(chip);
+    } else chip->PC += 2;
+}
+
+static void op_sknp(Chip_8 *chip, const Instruction *in) { // ExA1: skip next instruction if key Vx is not pressed
+    if (chip->key[chip->V[in->x] & 0xF] == 0) skip_next(chip);
+    else chip->PC += 2;
+    chip->key_pressed = true;
+}
+
+static void op_ld_vx_dt(Chip_8 *chip, const Instruction *in) { // Fx07: set Vx = delay_register
+    chip->V[in->x] = chip->delay_register;
+    // Fx07, 3x00, 1nnn back to the Fx07 polls the timer, which only changes at the end of the frame
+    if (chip->delay_register && chip->PC <= 0x0FFF && fetch_opcode(chip, chip->PC + 2) == (0x3000 | in->x << 8) &&
+        fetch_opcode(chip, chip->PC + 4) == (0x1000 | chip->PC))
+        chip->idle = 3;
+    chip->PC += 2;
+}
+
+static void op_ld_key(Chip_8 *chip, const Instruction *in) { // Fx0A: wait for key press, store key value in Vx
+    // the lowest pressed key, the instruction repeats until there is one
+    for (int i = 0; i < 16; i++) {
+        if (chip->key[i] != 0) {
+            chip->V[in->x] = i;
+            chip->PC += 2;
+            chip->key_pressed = true;
+            return;
+        }
+    }
+    chip->idle = 1;
+}
+
+static void op_ld_dt(Chip_8 *chip, const Instruction *in) { // Fx15: set delay_register = Vx
+    chip->delay_register = chip->V[in->x];
+    chip->PC += 2;
+}
+
+static void op_ld_st(Chip_8 *chip, const Instruction *in) { // Fx18: set sound_register = Vx
+    chip->sound_register = chip->V[in->x];
+    chip->PC += 2;
+}
+
+static void op_add_i(Chip_8 *chip, const Instruction *in) { // Fx1E: set I = I + Vx
+    chip->I += chip->V[in->x];
+    chip->PC += 2;
+}
+
+static void op_ld_font(Chip_8 *chip, const Instruction *in) { // Fx29: set I to the font sprite of digit Vx
+    chip->I = FONT_ADDRESS + chip->V[in->x] * 5;
+    chip->PC += 2;
+}
+
+static void op_ld_hires_font(Chip_8 *chip, const Instruction *in) { // Fx30: set I to the 8x10 sprite of digit Vx
+    chip->I = HIRES_FONT_ADDRESS + (chip->V[in->x] & 0xF) * 10;
+    chip->PC += 2;
+}
+
+static void op_bcd(Chip_8 *chip, const Instruction *in) { // Fx33: BCD-presentation of Vx at memory[I, I+1, I+2]
+    uint8_t Vx = chip->V[in->x];
+    write_memory(chip, chip->I, Vx / 100);
+    write_memory(chip, chip->I + 1, (Vx / 10) % 10);
+    write_memory(chip, chip->I + 2, Vx % 10);
+    chip->PC += 2;
+}
+
+static inline void store_registers(Chip_8 *chip, const Instruction *in, bool keep_i) {
+    for (int i = 0; i <= in->x; i++) write_memory(chip, chip->I + i, chip->V[i]);
+    if (!keep_i) chip->I += in->x + 1;
+    chip->PC += 2;
+}
+
+static inline void load_registers(Chip_8 *chip, const Instruction *in, bool keep_i) {
+    for (int i = 0; i <= in->x; i++) chip->V[i] = chip->memory[(chip->I + i) & chip->address_mask];
+    if (!keep_i) chip->I += in->x + 1;
+    chip->PC += 2;
+}
+
+static void op_store(Chip_8 *chip, const Instruction *in) { // Fx55: store V0...Vx in memory at I, I = I + x + 1
+    store_registers(chip, in, false);
+}
+
+static void op_store_keep_i(Chip_8 *chip, const Instruction *in) { // Fx55 with QUIRK_KEEP_I
+    store_registers(chip, in, true);
+}
+
+static void op_load(Chip_8 *chip, const Instruction *in) { // Fx65: store memory to V0...Vx starting at I, I = I + x + 1
+    load_registers(chip, in, false);
+}
+
+static void op_load_keep_i(Chip_8 *chip, const Instruction *in) { // Fx65 with QUIRK_KEEP_I
+    load_registers(chip, in, true);
+}
+
+static void op_save_flags(Chip_8 *chip, const Instruction *in) { // Fx75: store V0...Vx in the flag registers
+    memcpy(chip->flags, chip->V, in->x + 1);
+    chip->PC += 2;
+}
+
+static void op_load_flags(Chip_8 *chip, const Instruction *in) { // Fx85: load V0...Vx from the flag registers
+    memcpy(chip->V, chip->flags, in->x + 1);
+    chip->PC += 2;
+}
+
+static void op_ld_i_long(Chip_8 *chip, const Instruction *in) { // F000 nnnn: set I to the 16-bit address nnnn
+    (void) in;
+    chip->I = fetch_opcode(chip, chip->PC + 2);
+    chip->PC += 4;
+}
+
+static void op_plane(Chip_8 *chip, const Instruction *in) { // Fn01: select the planes n for drawing and scrolling
+    chip->plane_mask = in->x & ((1 << DISPLAY_PLANES) - 1);
+    chip->PC += 2;
+}
+
+static void op_audio(Chip_8 *chip, const Instruction *in) { // F002: load the audio pattern from memory at I
+    (void) in;
+    for (int i = 0; i < 16; i++) chip->pattern[i] = chip->memory[(chip->I + i) & chip->address_mask];
+    chip->audio_flag = true;
+    chip->PC += 2;
+}
+
+static void op_pitch(Chip_8 *chip, const Instruction *in) { // Fx3A: set the playback rate of the pattern to Vx
+    chip->pitch = chip->V[in->x];
+    chip->audio_flag = true;
+    chip->PC += 2;
+}
+
+// picks the handler for an opcode and extracts its operands
+void decode_instruction(uint16_t opcode, Machine machine, uint8_t quirks, Instruction *in) {
+    in->opcode = opcode;
+    in->x = (opcode & 0x0F00) >> 8;
+    in->y = (opcode & 0x00F0) >> 4;
+    in->n = opcode & 0x000F;
+    in->kk = opcode & 0x00FF;
+    in->nnn = opcode & 0x0FFF;
+
+    // CHIP-8 doesn't know the SCHIP instructions, SCHIP doesn't know the ones XO-CHIP added
+    bool schip = machine != MACHINE_CHIP8;
+    bool xo_chip = machine == MACHINE_XO_CHIP;
+    Handler handler = op_unknown;
+    switch (opcode >> 12) {
+        case 0x0:
+            if ((opcode & 0xFFF0) == 0x00C0) handler = schip ? op_scroll_down : op_unknown;
+            else if ((opcode & 0xFFF0) == 0x00D0) handler = xo_chip ? op_scroll_up : op_unknown;
+            else switch (opcode) {
+                case 0x00FB: handler = schip ? op_scroll_right : op_unknown; break;
+                case 0x00FC: handler = schip ? op_scroll_left : op_unknown; break;
+                case 0x00FD: handler = schip ? op_exit : op_unknown; break;
+                case 0x00FE: handler = schip ? op_lores : op_unknown; break;
+                case 0x00FF: handler = schip ? op_hires : op_unknown; break;
+                default:
+                    switch (opcode & 0x000F) {
+                        case 0x0000: handler = op_cls; break;
+                        case 0x000E: handler = op_ret; break;
+                    }
+            }
+            break;
+        case 0x1: handler = op_jp; break;
+        case 0x2: handler = op_call; break;
+        case 0x3: handler = op_se_byte; break;
+        case 0x4: handler = op_sne_byte; break;
+        case 0x5:
+            switch (opcode & 0x000F) {
+                case 0x0002: handler = xo_chip ? op_save_range : op_se_reg; break;
+                case 0x0003: handler = xo_chip ? op_load_range : op_se_reg; break;
+                default: handler = op_se_reg; break;
+            }
+            break;
+        case 0x6: handler = op_ld_byte; break;
+        case 0x7: handler = op_add_byte; break;
+        case 0x8:
+            switch (opcode & 0x000F) {
+                case 0x0000: handler = op_ld_reg; break;
+                case 0x0001: handler = quirks & QUIRK_VF_RESET ? op_or_vf_reset : op_or; break;
+                case 0x0002: handler = quirks & QUIRK_VF_RESET ? op_and_vf_reset : op_and; break;
+                case 0x0003: handler = quirks & QUIRK_VF_RESET ? op_xor_vf_reset : op_xor; break;
+                case 0x0004: handler = op_add_reg; break;
+                case 0x0005: handler = op_sub; break;
+                case 0x0006: handler = quirks & QUIRK_SHIFT ? op_shr_vx : op_shr; break;
+                case 0x0007: handler = op_subn; break;
+                case 0x000E: handler = quirks & QUIRK_SHIFT ? op_shl_vx : op_shl; break;
+            }
+            break;
+        case 0x9: handler = op_sne_reg; break;
+        case 0xA: handler = op_ld_i; break;
+        case 0xB: handler = quirks & QUIRK_JUMP_VX ? op_jp_vx : op_jp_v0; break;
+        case 0xC: handler = op_rnd; break;
+        case 0xD: {
+            static const Handler draw[4] = {op_drw, op_drw_clip, op_drw_wait, op_drw_clip_wait};
+            handler = draw[(quirks & QUIRK_CLIP ? 1 : 0) | (quirks & QUIRK_DISPLAY_WAIT ? 2 : 0)];
+            break;
+        }
+        case 0xE:
+            switch (opcode & 0x00FF) {
+                case 0x009E: handler = op_skp; break;
+                case 0x00A1: handler = op_sknp; break;
+            }
+            break;
+        case 0xF:
+            if (opcode == 0xF000) {
+                handler = xo_chip ? op_ld_i_long : op_unknown;
+                break;
+            }
+            if (opcode == 0xF002) {
+                handler = xo_chip ? op_audio : op_unknown;
+                break;
+            }
+            switch (opcode & 0x00FF) {
+                case 0x0001: handler = xo_chip ? op_plane : op_unknown; break;
+                case 0x0007: handler = op_ld_vx_dt; break;
+                case 0x000A: handler = op_ld_key; break;
+                case 0x0015: handler = op_ld_dt; break;
+                case 0x0018: handler = op_ld_st; break;
+                case 0x001E: handler = op_add_i; break;
+                case 0x0029: handler = op_ld_font; break;
+                case 0x0030: handler = schip ? op_ld_hires_font : op_unknown; break;
+                case 0x0033: handler = op_bcd; break;
+                case 0x003A: handler = xo_chip ? op_pitch : op_unknown; break;
+                case 0x0055: handler = quirks & QUIRK_KEEP_I ? op_store_keep_i : op_store; break;
+                case 0x0065: handler = quirks & QUIRK_KEEP_I ? op_load_keep_i : op_load; break;
+                case 0x0075: handler = schip ? op_save_flags : op_unknown; break;
+                case 0x0085: handler = schip ? op_load_flags : op_unknown; break;
+            }
+            break;
+    }
+    in->execute = handler;
+}
+
+// the class of every handler, the profile and the disassembler name instructions by it
+static const struct {
+    Handler handler;
+    Instruction_Class type;
+} handler_classes[] = {
+        {op_cls, CLASS_CLS}, {op_ret, CLASS_RET}, {op_scroll_down, CLASS_SCD}, {op_scroll_up, CLASS_SCU},
+        {op_scroll_right, CLASS_SCR}, {op_scroll_left, CLASS_SCL}, {op_exit, CLASS_EXIT}, {op_lores, CLASS_LOW},
+        {op_hires, CLASS_HIGH}, {op_jp, CLASS_JP}, {op_call, CLASS_CALL}, {op_se_byte, CLASS_SE_BYTE},
+        {op_sne_byte, CLASS_SNE_BYTE}, {op_se_reg, CLASS_SE_REG}, {op_save_range, CLASS_SAVE},
+        {op_load_range, CLASS_LOAD}, {op_ld_byte, CLASS_LD_BYTE}, {op_add_byte, CLASS_ADD_BYTE},
+        {op_ld_reg, CLASS_LD_REG}, {op_or, CLASS_OR}, {op_or_vf_reset, CLASS_OR}, {op_and, CLASS_AND},
+        {op_and_vf_reset, CLASS_AND}, {op_xor, CLASS_XOR}, {op_xor_vf_reset, CLASS_XOR}, {op_add_reg, CLASS_ADD_REG},
+        {op_sub, CLASS_SUB}, {op_shr, CLASS_SHR}, {op_shr_vx, CLASS_SHR}, {op_subn, CLASS_SUBN}, {op_shl, CLASS_SHL},
+        {op_shl_vx, CLASS_SHL}, {op_sne_reg, CLASS_SNE_REG}, {op_ld_i, CLASS_LD_I}, {op_jp_v0, CLASS_JP_V0},
+        {op_jp_vx, CLASS_JP_V0}, {op_rnd, CLASS_RND}, {op_drw, CLASS_DRW}, {op_drw_clip, CLASS_DRW},
+        {op_drw_wait, CLASS_DRW}, {op_drw_clip_wait, CLASS_DRW}, {op_skp, CLASS_SKP}, {op_sknp, CLASS_SKNP},
+        {op_ld_i_long, CLASS_LD_I_LONG}, {op_plane, CLASS_PLANE}, {op_audio, CLASS_AUDIO},
+        {op_ld_vx_dt, CLASS_LD_VX_DT}, {op_ld_key, CLASS_LD_K}, {op_ld_dt, CLASS_LD_DT}, {op_ld_st, CLASS_LD_ST},
+        {op_add_i, CLASS_ADD_I}, {op_ld_font, CLASS_LD_F}, {op_ld_hires_font, CLASS_LD_HF}, {op_bcd, CLASS_LD_B},
+        {op_pitch, CLASS_PITCH}, {op_store, CLASS_LD_MEM}, {op_store_keep_i, CLASS_LD_MEM}, {op_load, CLASS_LD_VX_MEM},
+        {op_load_keep_i, CLASS_LD_VX_MEM}, {op_save_flags, CLASS_LD_R}, {op_load_flags, CLASS_LD_VX_R},
+};
+
+Instruction_Class instruction_class(const Instruction *in) {
+    for (size_t i = 0; i < sizeof(handler_classes) / sizeof(handler_classes[0]); i++) {
+        if (handler_classes[i].handler == in->execute) return handler_classes[i].type;
+    }
+    return CLASS_UNKNOWN;
+}
+
+bool ends_block(const Instruction *in) {
+    Handler h = in->execute;
+    return h == op_jp || h == op_call || h == op_ret || h == op_jp_v0 || h == op_jp_vx ||
+           h == op_se_byte || h == op_sne_byte || h == op_se_reg || h == op_sne_reg || h == op_skp || h == op_sknp ||
+           h == op_ld_key || h == op_drw_wait || h == op_drw_clip_wait ||
+           h == op_bcd || h == op_store || h == op_store_keep_i || h == op_save_range || h == op_ld_i_long ||
+           h == op_exit || h == op_unknown;
+}
+
+bool is_static_jump(const Instruction *in) {
+    return in->execute == op_jp;
+}
+
+bool is_unknown_opcode(const Instruction *in) {
+    return in->execute == op_unknown;
+}
+
+void decode_and_execute(Chip_8 *chip) {
+    Instruction in;
+    decode_instruction(chip->opcode, chip->machine, chip->quirks, &in);
+    PROFILE_STEP(chip->profile, chip->PC, in.opcode);
+    TRACE_PC(pc, chip);
+    in.execute(chip, &in);
+    TRACE_STEP(chip, pc, &in);
+}
+
+uint16_t fetch_opcode(const Chip_8 *chip, uint16_t address) {
+    // the opcode is two bytes long, the memory-array contains one byte-addresses each. We concatenate both bytes:
+    return chip->memory[address & chip->address_mask] << 8 | chip->memory[(address + 1) & chip->address_mask];
+}
+
+void emulate(Chip_8 *chip) {
+    if (chip->halted) return;
+    // ---fetch opcode---
+    chip->opcode = fetch_opcode(chip, chip->PC);
+    // ---decode & execute opcode---
+    decode_and_execute(chip);
+}
+
+void init_decode_cache(Decode_Cache *cache) {
+    memset(cache, 0, sizeof(*cache));
+}
+
+// drops the decoded instructions of every page that was written since the last call
+static void invalidate_dirty_pages(Chip_8 *chip, Decode_Cache *cache) {
+    if (chip->code_dirty & CODE_STALE) {
+        memset(cache->insn, 0, sizeof(cache->insn));
+        memset(chip->code_pages, 0, sizeof(chip->code_pages));
+    } else {
+        for (int word = 0; word < CODE_PAGE_WORDS; word++) {
+            uint64_t dirty = chip->dirty_pages[word];
+            // the page is decoded again on the next instruction fetched from it
+            chip->code_pages[word] &= ~dirty;
+            while (dirty) {
+                int page = word * 64 + __builtin_ctzll(dirty);
+                dirty &= dirty - 1;
+                // the instruction starting on the last byte of the previous page overlaps this one
+                int start = page * CODE_PAGE_SIZE - 1;
+                if (start < 0) start = 0;
+                int end = (page + 1) * CODE_PAGE_SIZE;
+                memset(&cache->insn[start], 0, (end - start) * sizeof(Instruction));
+            }
+        }
+    }
+    memset(chip->dirty_pages, 0, sizeof(chip->dirty_pages));
+    chip->code_dirty = 0;
+}
+
+unsigned int run_cached(Chip_8 *chip, Decode_Cache *cache, unsigned int cycles) {
+    unsigned int executed = 0;
+    while (executed < cycles && !chip->halted) {
+        if (chip->code_dirty) invalidate_dirty_pages(chip, cache);
+        Instruction *in = &cache->insn[chip->PC & chip->address_mask];
+        if (!in->execute) {
+            decode_instruction(fetch_opcode(chip, chip->PC), chip->machine, chip->quirks, in);
+            mark_code_page(chip, chip->PC);
+        }
+        chip->opcode = in->opcode;
+        PROFILE_STEP(chip->profile, chip->PC, in->opcode);
+        TRACE_PC(pc, chip);
+        in->execute(chip, in);
+        TRACE_STEP(chip, pc, in);
+        executed++;
+        if (chip->idle) executed += skip_idle(chip, cycles - executed);
+    }
+    return executed;
+}
+
+unsigned int skip_idle(Chip_8 *chip, unsigned int remaining) {
+    unsigned int skipped = remaining - remaining % chip->idle;
+    chip->idle = 0;
+    chip->skipped += skipped;
+    PROFILE_IDLE(chip->profile, skipped);
+    TRACE_SKIP(chip, skipped);
+    return skipped;
+}
+
+void tick_timers(Chip_8 *chip) {
+    if (chip->delay_register > 0) chip->delay_register--;
+    if (chip->sound_register > 0) chip->sound_register--;
+}
+
+void init_opcode_table(Instruction *table, Machine machine, uint8_t quirks) {
+    for (uint32_t opcode = 0; opcode <= 0xFFFF; opcode++) decode_instruction(opcode, machine, quirks, &table[opcode]);
+}
+
+unsigned int run_opcode_table(Chip_8 *chip, const Instruction *table, unsigned int cycles) {
+    unsigned int executed = 0;
+    while (executed < cycles && !chip->halted) {
+        const Instruction *in = &table[fetch_opcode(chip, chip->PC)];
+        chip->opcode = in->opcode;
+        PROFILE_STEP(chip->profile, chip->PC, in->opcode);
+        TRACE_PC(pc, chip);
+        in->execute(chip, in);
+        TRACE_STEP(chip, pc, in);
+        executed++;
+        if (chip->idle) executed += skip_idle(chip, cycles - executed);
+    }
+    return executed;
+}
+
+void init_engine(Engine *engine, Engine_Type type) {
+    engine->type = type;
+    if (type == ENGINE_DECODE_CACHE) init_decode_cache(&engine->cache);
+    else if (type == ENGINE_BLOCKS) init_block_cache(&engine->blocks);
+}
+
+unsigned int run_engine(Chip_8 *chip, Engine *engine, unsigned int cycles) {
+    switch (engine->type) {
+        case ENGINE_DECODE_CACHE:
+            return run_cached(chip, &engine->cache, cycles);
+        case ENGINE_BLOCKS:
+            return run_blocks(chip, &engine->blocks, cycles);
+        default: {
+            unsigned int executed = 0;
+            while (executed < cycles && !chip->halted) {
+                emulate(chip);
+                executed++;
+                if (chip->idle) executed += skip_idle(chip, cycles - executed);
+            }
+            return executed;
+        }
+    }
+}
+
+void set_key(Chip_8 *chip, int key, bool pressed) {
+    chip->idle = 0; // a waiting program may continue
+    if (pressed && key >= 0 && key < 16) chip->key[key] = 1;
+    else if (!pressed) chip->key_released = true;
+}
+
+void seed_random(Chip_8 *chip, uint32_t seed) {
+    chip->rng = seed ? seed : RNG_SEED;
+}
+
+uint64_t program_hash(const Chip_8 *chip) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i <= chip->address_mask; i++) {
+        hash ^= chip->memory[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+void end_frame(Chip_8 *chip) {
+    tick_timers(chip);
+    chip->vblank = true;
+    chip->idle = 0;
+    PROFILE_FRAME(chip->profile);
+    // once the rom has read a key and any key was let go, all keys are released
+    if (chip->key_pressed && chip->key_released) {
+        memset(chip->key, 0, sizeof(chip->key));
+        chip->key_pressed = false;
+        chip->key_released = false;
+    }
+}
+
+unsigned int run_frame(Chip_8 *chip, Engine *engine, unsigned int cycles) {
+    unsigned int executed = run_engine(chip, engine, cycles);
+    end_frame(chip);
+    return executed;
+}
+
+void predecode(Chip_8 *chip, Engine *engine, uint16_t address) {
+    address &= chip->address_mask;
+    if (engine->type == ENGINE_BLOCKS) predecode_block(chip, &engine->blocks, address);
+    if (engine->type != ENGINE_DECODE_CACHE) return;
+    // written pages are dropped first, like run_cached() does
+    if (chip->code_dirty) invalidate_dirty_pages(chip, &engine->cache);
+    Instruction *in = &engine->cache.insn[address];
+    if (!in->execute) {
+        decode_instruction(fetch_opcode(chip, address), chip->machine, chip->quirks, in);
+        mark_code_page(chip, address);
+    }
+}
+
+uint64_t display_hash(const Chip_8 *chip) {
+    const Display *display = &chip->display;
+    int height = display_height(display);
+    int words = display_width(display) / 64;
+    // only XO-CHIP draws into the second plane
+    int planes = chip->machine == MACHINE_XO_CHIP ? DISPLAY_PLANES : 1;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int plane = 0; plane < planes; plane++) {
+        for (int y = 0; y < height; y++) {
+            for (int word = 0; word < words; word++) {
+                for (int shift = 56; shift >= 0; shift -= 8) {
+                    hash ^= (display->planes[plane][y][word] >> shift) & 0xFF;
+                    hash *= 0x100000001b3ULL;
+                }
+            }
+        }
+    }
+    return hash;
+}
+
+// indexed by the colour of a pixel, plane 0 is bit 0
+static const uint32_t palette[1 << DISPLAY_PLANES] = {0xFF000000, 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555};
+
+void expand_display(const Display *display, uint32_t *pixels, int pitch) {
+    expand_display_rows(display, 0, display_height(display), pixels, pitch);
+}
+
+void expand_display_rows(const Display *display, int first, int count, uint32_t *pixels, int pitch) {
+    int words = display_width(display) / 64;
+    for (int y = first; y < first + count; y++) {
+        uint32_t *row = (uint32_t *) ((uint8_t *) pixels + (y - first) * pitch);
+        for (int word = 0; word < words; word++) {
+            uint64_t low = display->planes[0][y][word];
+            uint64_t high = display->planes[1][y][word];
+            for (int x = 0; x < 64; x++) {
+                int shift = 63 - x;
+                *row++ = palette[((low >> shift) & 1) | ((high >> shift) & 1) << 1];
+            }
+        }
+    }
+}
@@ -0,0 +1,347 @@
+#ifndef CHIP_8_CHIP8_H
+#define CHIP_8_CHIP8_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "profile.h"
+
+// frequency for emulation and timers
+#define FRAME_RATE 400
+#define TIMER_HZ 60
+// instructions executed per 60 Hz timer tick, rounded to the nearest whole cycle
+#define CYCLES_PER_FRAME ((FRAME_RATE + TIMER_HZ / 2) / TIMER_HZ)
+
+// low resolution, the only one of CHIP-8
+#define DISPLAY_WIDTH 64
+#define DISPLAY_HEIGHT 32
+// high resolution of SCHIP and XO-CHIP (00FF)
+#define HIRES_WIDTH 128
+#define HIRES_HEIGHT 64
+#define DISPLAY_PLANES 2 // XO-CHIP draws into two bitplanes, giving four colours
+#define ROW_WORDS (HIRES_WIDTH / 64)
+
+// 64KB of XO-CHIP, CHIP-8 and SCHIP only address the first 4KB
+#define MEMORY_SIZE 0x10000
+#define STACK_SIZE 16 // return addresses, SP counts the ones in use
+#define FONT_ADDRESS 0x000 // 4x5 digits, Fx29
+#define HIRES_FONT_ADDRESS 0x050 // 8x10 digits, Fx30
+
+#define RNG_SEED 0x2545F491u
+
+// quirks, behaviour that differs between CHIP-8 interpreters. the handlers come in a variant for
+// each setting and the decoder picks one, so executing an instruction never tests a quirk
+#define QUIRK_CLIP 0x01 // sprites are clipped at the screen edges instead of wrapping around
+#define QUIRK_SHIFT 0x02 // 8xy6 and 8xyE shift Vx in place instead of setting Vx to the shifted Vy
+#define QUIRK_KEEP_I 0x04 // Fx55 and Fx65 leave I unchanged instead of advancing it past Vx
+#define QUIRK_JUMP_VX 0x08 // Bxnn jumps to xnn + Vx instead of nnn + V0
+#define QUIRK_VF_RESET 0x10 // 8xy1, 8xy2 and 8xy3 set VF to 0
+#define QUIRK_DISPLAY_WAIT 0x20 // Dxyn waits for the start of the next frame, drawing at most one sprite per frame
+
+// quirk profiles of the interpreters programs were written for
+#define QUIRKS_CHIP8 QUIRK_SHIFT // the default of this emulator, Octo with the shifts of SUPER-CHIP
+#define QUIRKS_VIP (QUIRK_CLIP | QUIRK_VF_RESET | QUIRK_DISPLAY_WAIT) // the original COSMAC VIP interpreter
+#define QUIRKS_SCHIP (QUIRK_CLIP | QUIRK_SHIFT | QUIRK_KEEP_I | QUIRK_JUMP_VX) // SUPER-CHIP 1.1 as modern interpreters run it
+#define QUIRKS_XO_CHIP 0 // Octo
+
+// memory is tracked in 64-byte pages for invalidating decoded instructions, one bit per page
+#define CODE_PAGE_BITS 6
+#define CODE_PAGE_SIZE (1 << CODE_PAGE_BITS)
+#define CODE_PAGES (MEMORY_SIZE / CODE_PAGE_SIZE)
+#define CODE_PAGE_WORDS (CODE_PAGES / 64)
+
+// what changed in memory since the engine last checked, see Chip_8.code_dirty
+#define CODE_WRITTEN 1 // pages in dirty_pages were written
+#define CODE_STALE 2 // everything decoded is stale: new program, quirks or snapshot
+
+typedef enum Machine {
+    MACHINE_CHIP8,
+    MACHINE_SCHIP, // 128x64, 16x16 sprites, scrolling, flag registers
+    MACHINE_XO_CHIP // SCHIP plus 64KB memory, two bitplanes and an audio pattern buffer
+} Machine;
+
+// why a machine stopped, only meaningful while Chip_8.halted is set
+typedef enum Halt_Reason {
+    HALT_UNKNOWN_OPCODE, // Chip_8.opcode holds the opcode
+    HALT_EXIT, // the program ended itself with 00FD, which isn't an error
+    HALT_STACK_OVERFLOW, // 2nnn with all STACK_SIZE return addresses in use
+    HALT_STACK_UNDERFLOW // 00EE with nothing to return to
+} Halt_Reason;
+
+// CHIP-8 and SCHIP wrap around at 4KB
+static inline uint16_t address_mask(Machine machine) {
+    return machine == MACHINE_XO_CHIP ? MEMORY_SIZE - 1 : 0x0FFF;
+}
+
+// the quirk profile a machine starts with
+static inline uint8_t machine_quirks(Machine machine) {
+    switch (machine) {
+        case MACHINE_SCHIP: return QUIRKS_SCHIP;
+        case MACHINE_XO_CHIP: return QUIRKS_XO_CHIP;
+        default: return QUIRKS_CHIP8;
+    }
+}
+
+// display - top-left (0,0) to bottom-right (63,31), (127,63) in high resolution.
+// every row is two 64-bit words, the most significant bit of the first word is the left-most pixel.
+// in low resolution only the first word of the first 32 rows is used
+typedef struct Display {
+    uint64_t planes[DISPLAY_PLANES][HIRES_HEIGHT][ROW_WORDS];
+    bool hires;
+} Display;
+
+static inline int display_width(const Display *display) {
+    return display->hires ? HIRES_WIDTH : DISPLAY_WIDTH;
+}
+
+static inline int display_height(const Display *display) {
+    return display->hires ? HIRES_HEIGHT : DISPLAY_HEIGHT;
+}
+
+// colour of a pixel, bit n is set in plane n
+static inline int get_pixel(const Display *display, int x, int y) {
+    int color = 0;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        color |= ((display->planes[plane][y][x >> 6] >> (63 - (x & 63))) & 1) << plane;
+    }
+    return color;
+}
+
+// pixels that may have changed, kept per row and per column so frontends and encoders only
+// update what a frame touched. a sprite drawn and erased again within a frame stays marked,
+// display_changed() tells if the pixels actually differ
+typedef struct Dirty_Region {
+    uint64_t rows; // bit y is set for row y
+    uint64_t columns[ROW_WORDS]; // the columns of all marked rows, laid out like a display row
+} Dirty_Region;
+
+// the bounding rectangle of a dirty region
+typedef struct Dirty_Rect {
+    int x, y, width, height;
+} Dirty_Rect;
+
+typedef struct Trace Trace; // see trace.h
+
+typedef struct Chip_8 {
+    uint8_t memory[MEMORY_SIZE];
+    unsigned short opcode;
+    // registers
+    uint8_t V[16]; // general purpose 8-bit registers
+    uint16_t I; // 16-bit register for memory addresses
+
+    // special registers
+    uint8_t delay_register;
+    uint8_t sound_register;
+
+    // pointer & addresses
+    uint16_t PC; // program counter
+    uint8_t SP; // stack pointer
+    uint16_t stack[STACK_SIZE]; // stack used to store addresses for subroutines
+
+    // keyboard
+    uint8_t key[16];
+
+    Display display;
+    bool draw_flag;
+    Dirty_Region dirty; // pixels changed by Dxyn, 00E0 and scrolling since the frontend took them
+    bool key_pressed; // a key was read since the keys were last released
+    bool key_released; // a key was let go since the keys were last released
+    bool halted; // the machine stopped executing, see halt_reason
+    Halt_Reason halt_reason;
+    uint8_t code_dirty; // CODE_* flags, checked by the engines before executing
+    uint64_t code_pages[CODE_PAGE_WORDS]; // pages the engine decoded instructions from, stores elsewhere are free
+    uint64_t dirty_pages[CODE_PAGE_WORDS]; // pages of code_pages written since the engine last checked
+    uint8_t quirks; // QUIRK_* flags, change them through set_quirks()
+    bool vblank; // a frame started since the last sprite was drawn, see QUIRK_DISPLAY_WAIT
+    uint8_t idle; // length of a loop the program spins in until the next frame or key, 0 if it doesn't
+    uint64_t skipped; // instructions of idle loops that were skipped instead of executed, see skip_idle()
+    uint32_t rng; // state of the random number generator used by Cxkk, never 0
+
+    // SCHIP and XO-CHIP
+    Machine machine;
+    uint16_t address_mask; // 0xFFFF on XO-CHIP, 0x0FFF otherwise
+    uint8_t plane_mask; // planes drawn, scrolled and cleared, selected by Fn01
+    uint8_t flags[16]; // flag registers of Fx75 and Fx85
+    uint8_t pattern[16]; // audio pattern buffer, 128 1-bit samples loaded by F002
+    uint8_t pitch; // playback rate of the pattern, set by Fx3A
+    bool audio_flag; // set when the pattern or pitch changed
+#ifdef CHIP8_PROFILE
+    Profile *profile; // NULL if not profiled, not shared between threads
+#endif
+#ifdef CHIP8_TRACE
+    Trace *trace; // NULL if not traced
+#endif
+} Chip_8;
+
+typedef struct Instruction Instruction;
+typedef void (*Handler)(Chip_8 *chip, const Instruction *in);
+
+// an opcode decoded into its handler and pre-extracted operands
+struct Instruction {
+    Handler execute; // NULL if not decoded yet
+    uint16_t opcode;
+    uint16_t nnn;
+    uint8_t x, y, n, kk;
+};
+
+// what an instruction does, named after Cowgod's mnemonics and the SCHIP / XO-CHIP extensions.
+// the quirk variants of a handler share the class of their instruction
+typedef enum Instruction_Class {
+    CLASS_CLS, CLASS_RET, CLASS_SCD, CLASS_SCU, CLASS_SCR, CLASS_SCL, CLASS_EXIT, CLASS_LOW, CLASS_HIGH, CLASS_JP,
+    CLASS_CALL, CLASS_SE_BYTE, CLASS_SNE_BYTE, CLASS_SE_REG, CLASS_SAVE, CLASS_LOAD, CLASS_LD_BYTE, CLASS_ADD_BYTE,
+    CLASS_LD_REG, CLASS_OR, CLASS_AND, CLASS_XOR, CLASS_ADD_REG, CLASS_SUB, CLASS_SHR, CLASS_SUBN, CLASS_SHL,
+    CLASS_SNE_REG, CLASS_LD_I, CLASS_JP_V0, CLASS_RND, CLASS_DRW, CLASS_SKP, CLASS_SKNP, CLASS_LD_I_LONG, CLASS_PLANE,
+    CLASS_AUDIO, CLASS_LD_VX_DT, CLASS_LD_K, CLASS_LD_DT, CLASS_LD_ST, CLASS_ADD_I, CLASS_LD_F, CLASS_LD_HF, CLASS_LD_B,
+    CLASS_PITCH, CLASS_LD_MEM, CLASS_LD_VX_MEM, CLASS_LD_R, CLASS_LD_VX_R, CLASS_UNKNOWN,
+    INSTRUCTION_CLASSES
+} Instruction_Class;
+
+// decoded instructions indexed by PC, entries of written pages are dropped before executing
+typedef struct Decode_Cache {
+    Instruction insn[MEMORY_SIZE];
+} Decode_Cache;
+
+// superblocks: runs of decoded instructions that are translated once and executed back to back
+#define MAX_BLOCK_LENGTH 32
+#define BLOCK_POOL_SIZE 16384
+#define BLOCK_LINKS BLOCK_POOL_SIZE // pages covered by the blocks, a block usually covers one or two
+#define NO_LINK 0xFFFF
+
+// links a block into the list of a page it covers. the links of a block are allocated together,
+// in the order of the blocks in the pool
+typedef struct Block_Link {
+    uint16_t start, first; // the block, stale once the block at start was dropped or translated again
+    uint16_t page;
+    uint16_t next; // link of the next block on the same page, NO_LINK at the end
+} Block_Link;
+
+// blocks indexed by start address. a block follows unconditional jumps and calls and ends at
+// returns, skips, computed jumps and instructions that wait or write memory.
+// the blocks covering a written page are found through the page's list and dropped before executing
+typedef struct Block_Cache {
+    uint16_t first[MEMORY_SIZE]; // index of the first instruction of each block in the pool
+    uint8_t length[MEMORY_SIZE]; // 0 if no block was translated at this address
+    Instruction pool[BLOCK_POOL_SIZE];
+    unsigned int used; // instructions allocated from the pool
+    uint16_t page_blocks[CODE_PAGES]; // first link of the blocks covering each page
+    Block_Link links[BLOCK_LINKS];
+    unsigned int links_used;
+} Block_Cache;
+
+typedef enum Engine_Type {
+    ENGINE_INTERPRETER, // fetch and decode every instruction
+    ENGINE_DECODE_CACHE,
+    ENGINE_BLOCKS
+} Engine_Type;
+
+// the execution strategy of a frontend, large enough to be kept in static storage
+typedef struct Engine {
+    Engine_Type type;
+    union {
+        Decode_Cache cache;
+        Block_Cache blocks;
+    };
+} Engine;
+
+void init_chip(Chip_8 *chip);
+// switches to another machine, resets the display and selects the addressable memory and quirk profile
+void set_machine(Chip_8 *chip, Machine machine);
+// selects the QUIRK_* flags, instructions decoded with the previous ones are dropped
+void set_quirks(Chip_8 *chip, uint8_t quirks);
+// parses a comma separated list of profiles (chip8, vip, schip, xo) and quirks (clip, shift, keep-i,
+// jump-vx, vf-reset, display-wait) from left to right. a profile replaces `quirks`, a quirk is added to them.
+// returns -1 for an unknown name, `quirks` is left unchanged then
+int parse_quirks(const char *names, uint8_t *quirks);
+// picks the machine from the extension of a rom, .sc8 for SCHIP and .xo8 for XO-CHIP
+Machine machine_from_path(const char *path);
+// loads a rom at 0x200, returns its size or -1 if it can't be read or is larger than the addressable memory
+int load_program_to_memory(Chip_8 *chip, char *path);
+// copies a rom from memory to 0x200, returns -1 if it is empty or larger than the addressable memory
+int load_program(Chip_8 *chip, const uint8_t *data, size_t size);
+
+uint16_t fetch_opcode(const Chip_8 *chip, uint16_t address);
+// picks the handler variant for the QUIRK_* flags `quirks`. opcodes the machine doesn't have, e.g. 00FF on
+// CHIP-8, decode as unknown
+void decode_instruction(uint16_t opcode, Machine machine, uint8_t quirks, Instruction *in);
+// the class of a decoded instruction, found from its handler
+Instruction_Class instruction_class(const Instruction *in);
+// true if execution can't continue straight to the next instruction
+bool ends_block(const Instruction *in);
+// true for 1nnn, which always continues at nnn. 2nnn halts on a full stack instead
+bool is_static_jump(const Instruction *in);
+// true for opcodes no machine knows, they halt the machine
+bool is_unknown_opcode(const Instruction *in);
+void decode_and_execute(Chip_8 *chip);
+void emulate(Chip_8 *chip);
+
+// marks the pages of the instruction at `address` as decoded, so stores to them invalidate it
+static inline void mark_code_page(Chip_8 *chip, uint16_t address) {
+    unsigned int page = (address & chip->address_mask) >> CODE_PAGE_BITS;
+    unsigned int next = ((address + 1) & chip->address_mask) >> CODE_PAGE_BITS;
+    chip->code_pages[page / 64] |= 1ULL << (page & 63);
+    chip->code_pages[next / 64] |= 1ULL << (next & 63);
+}
+
+void init_decode_cache(Decode_Cache *cache);
+// executes up to `cycles` instructions through the decode cache, returns the number of executed instructions
+unsigned int run_cached(Chip_8 *chip, Decode_Cache *cache, unsigned int cycles);
+
+// every opcode decoded up front. the table doesn't depend on memory contents, so it never needs
+// invalidation and can be shared read-only by any number of machines with the same machine and quirks
+#define OPCODE_TABLE_SIZE 65536
+void init_opcode_table(Instruction *table, Machine machine, uint8_t quirks);
+unsigned int run_opcode_table(Chip_8 *chip, const Instruction *table, unsigned int cycles);
+
+// waiting for a key or the display (Fx0A, Dxyn with QUIRK_DISPLAY_WAIT), polling the delay timer
+// (Fx07, 3x00, 1nnn) and jumping to the same address spin in a loop that can't end before the frame
+// does or a key changes. the engines
+// skip whole turns of the loop instead of running them, the machine ends the frame in the same state.
+// returns how many of the `remaining` cycles are skipped
+unsigned int skip_idle(Chip_8 *chip, unsigned int remaining);
+
+void init_block_cache(Block_Cache *cache);
+// executes up to `cycles` instructions block by block, returns the number of executed instructions
+unsigned int run_blocks(Chip_8 *chip, Block_Cache *cache, unsigned int cycles);
+// translates the block at `start` unless it is translated already or the pool is full
+void predecode_block(Chip_8 *chip, Block_Cache *cache, uint16_t start);
+
+void init_engine(Engine *engine, Engine_Type type);
+unsigned int run_engine(Chip_8 *chip, Engine *engine, unsigned int cycles);
+// decrements delay and sound register, called at TIMER_HZ
+void tick_timers(Chip_8 *chip);
+// ticks the timers and releases the keys at the end of a 60 Hz frame
+void end_frame(Chip_8 *chip);
+// runs up to `cycles` instructions followed by end_frame(), returns the number of executed instructions
+unsigned int run_frame(Chip_8 *chip, Engine *engine, unsigned int cycles);
+// decodes the instruction at `address` before it runs, for the blocks engine translates the block
+// starting there. call it once the rom and the quirks are set, e.g. with the code found by analyze_rom()
+void predecode(Chip_8 *chip, Engine *engine, uint16_t address);
+
+// input from the frontend, `key` is the chip-8 key or -1 for releasing an unmapped key.
+// keys stay pressed until the rom has read one and any key was let go, see end_frame()
+void set_key(Chip_8 *chip, int key, bool pressed);
+// sets the state of the random number generator used by Cxkk
+void seed_random(Chip_8 *chip, uint32_t seed);
+
+// FNV-1a hash over the addressable memory, identifies the loaded program
+uint64_t program_hash(const Chip_8 *chip);
+// FNV-1a hash over the visible display, used to compare frames of headless runs
+uint64_t display_hash(const Chip_8 *chip);
+// expands the visible display into display_width() x display_height() 32-bit ARGB pixels,
+// `pitch` is the length of a row in bytes
+void expand_display(const Display *display, uint32_t *pixels, int pitch);
+// expands `count` rows starting at row `first`, `pixels` points to the first of them
+void expand_display_rows(const Display *display, int first, int count, uint32_t *pixels, int pitch);
+
+// marks the whole display dirty, for changes that don't go through the drawing instructions
+void mark_display_dirty(Chip_8 *chip);
+// adds the pixels changed since the last call to `region` and starts a new region
+void take_dirty(Chip_8 *chip, Dirty_Region *region);
+// marks the pixels that differ between two displays, all of them if the resolution differs
+void diff_display(const Display *a, const Display *b, Dirty_Region *region);
+// true if two displays differ within `region`
+bool display_changed(const Dirty_Region *region, const Display *a, const Display *b);
+// the bounding rectangle of `region` within the visible display, false if nothing visible is marked
+bool dirty_rect(const Dirty_Region *region, const Display *display, Dirty_Rect *rect);
+
+#endif //CHIP_8_CHIP8_H
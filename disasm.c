@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include "disasm.h"
+#include "chip8.h"
+
+static int emit(char *text, size_t size, int length, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, size, format, args);
+    va_end(args);
+    return length;
+}
+
+// names the class decode_instruction() finds for the opcode, with the operands it extracted. XO-CHIP
+// knows every instruction
+int disassemble(uint16_t opcode, uint16_t next, char *text, size_t size) {
+    Instruction in;
+    decode_instruction(opcode, MACHINE_XO_CHIP, 0, &in);
+    unsigned int x = in.x, y = in.y;
+    switch (instruction_class(&in)) {
+        case CLASS_CLS: return emit(text, size, 2, "CLS");
+        case CLASS_RET: return emit(text, size, 2, "RET");
+        case CLASS_SCD: return emit(text, size, 2, "SCD %u", in.n);
+        case CLASS_SCU: return emit(text, size, 2, "SCU %u", in.n);
+        case CLASS_SCR: return emit(text, size, 2, "SCR");
+        case CLASS_SCL: return emit(text, size, 2, "SCL");
+        case CLASS_EXIT: return emit(text, size, 2, "EXIT");
+        case CLASS_LOW: return emit(text, size, 2, "LOW");
+        case CLASS_HIGH: return emit(text, size, 2, "HIGH");
+        case CLASS_JP: return emit(text, size, 2, "JP %03X", in.nnn);
+        case CLASS_CALL: return emit(text, size, 2, "CALL %03X", in.nnn);
+        case CLASS_SE_BYTE: return emit(text, size, 2, "SE V%X, %02X", x, in.kk);
+        case CLASS_SNE_BYTE: return emit(text, size, 2, "SNE V%X, %02X", x, in.kk);
+        case CLASS_SE_REG: return emit(text, size, 2, "SE V%X, V%X", x, y);
+        case CLASS_SAVE: return emit(text, size, 2, "SAVE V%X - V%X", x, y);
+        case CLASS_LOAD: return emit(text, size, 2, "LOAD V%X - V%X", x, y);
+        case CLASS_LD_BYTE: return emit(text, size, 2, "LD V%X, %02X", x, in.kk);
+        case CLASS_ADD_BYTE: return emit(text, size, 2, "ADD V%X, %02X", x, in.kk);
+        case CLASS_LD_REG: return emit(text, size, 2, "LD V%X, V%X", x, y);
+        case CLASS_OR: return emit(text, size, 2, "OR V%X, V%X", x, y);
+        case CLASS_AND: return emit(text, size, 2, "AND V%X, V%X", x, y);
+        case CLASS_XOR: return emit(text, size, 2, "XOR V%X, V%X", x, y);
+        case CLASS_ADD_REG: return emit(text, size, 2, "ADD V%X, V%X", x, y);
+        case CLASS_SUB: return emit(text, size, 2, "SUB V%X, V%X", x, y);
+        case CLASS_SHR: return emit(text, size, 2, "SHR V%X {, V%X}", x, y);
+        case CLASS_SUBN: return emit(text, size, 2, "SUBN V%X, V%X", x, y);
+        case CLASS_SHL: return emit(text, size, 2, "SHL V%X {, V%X}", x, y);
+        case CLASS_SNE_REG: return emit(text, size, 2, "SNE V%X, V%X", x, y);
+        case CLASS_LD_I: return emit(text, size, 2, "LD I, %03X", in.nnn);
+        case CLASS_JP_V0: return emit(text, size, 2, "JP V0, %03X", in.nnn);
+        case CLASS_RND: return emit(text, size, 2, "RND V%X, %02X", x, in.kk);
+        case CLASS_DRW: return emit(text, size, 2, "DRW V%X, V%X, %u", x, y, in.n);
+        case CLASS_SKP: return emit(text, size, 2, "SKP V%X", x);
+        case CLASS_SKNP: return emit(text, size, 2, "SKNP V%X", x);
+        case CLASS_LD_I_LONG: return emit(text, size, 4, "LD I, %04X", next);
+        case CLASS_PLANE: return emit(text, size, 2, "PLANE %X", x);
+        case CLASS_AUDIO: return emit(text, size, 2, "AUDIO");
+        case CLASS_LD_VX_DT: return emit(text, size, 2, "LD V%X, DT", x);
+        case CLASS_LD_K: return emit(text, size, 2, "LD V%X, K", x);
+        case CLASS_LD_DT: return emit(text, size, 2, "LD DT, V%X", x);
+        case CLASS_LD_ST: return emit(text, size, 2, "LD ST, V%X", x);
+        case CLASS_ADD_I: return emit(text, size, 2, "ADD I, V%X", x);
+        case CLASS_LD_F: return emit(text, size, 2, "LD F, V%X", x);
+        case CLASS_LD_HF: return emit(text, size, 2, "LD HF, V%X", x);
+        case CLASS_LD_B: return emit(text, size, 2, "LD B, V%X", x);
+        case CLASS_PITCH: return emit(text, size, 2, "PITCH V%X", x);
+        case CLASS_LD_MEM: return emit(text, size, 2, "LD [I], V%X", x);
+        case CLASS_LD_VX_MEM: return emit(text, size, 2, "LD V%X, [I]", x);
+        case CLASS_LD_R: return emit(text, size, 2, "LD R, V%X", x);
+        case CLASS_LD_VX_R: return emit(text, size, 2, "LD V%X, R", x);
+        default: return emit(text, size, 2, "DW %04X", opcode);
+    }
+}
@@ -0,0 +1,12 @@
+#ifndef CHIP_8_DISASM_H
+#define CHIP_8_DISASM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// writes the instruction in Cowgod's mnemonics and the SCHIP / XO-CHIP extensions, e.g. "DRW V1, V2, 5".
+// `next` is the word following the opcode, only used by F000 which loads it into I.
+// returns the length of the instruction in bytes
+int disassemble(uint16_t opcode, uint16_t next, char *text, size_t size);
+
+#endif //CHIP_8_DISASM_H
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "golden.h"
+
+#define MAX_LINE_LENGTH 2048
+
+// characters of the colours 0 to 3, plane 0 is bit 0
+static const char pixel_chars[] = ".#+*";
+
+static void set_pixel(Display *display, int x, int y, int color) {
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        if (color & (1 << plane)) display->planes[plane][y][x >> 6] |= 1ULL << (63 - (x & 63));
+    }
+}
+
+// reads the rows of a frame following an entry, returns -1 if they don't form a display
+static int read_frame(FILE *file, Display *frame) {
+    memset(frame, 0, sizeof(*frame));
+    char line[MAX_LINE_LENGTH];
+    int width = 0, height = 0;
+    long start = ftell(file);
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "rom ", 4) == 0) {
+            fseek(file, start, SEEK_SET); // the next entry
+            break;
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        int length = (int) strlen(line);
+        if (length == 0) continue;
+        if ((width && length != width) || length > HIRES_WIDTH || height == HIRES_HEIGHT) return -1;
+        width = length;
+        for (int x = 0; x < width; x++) {
+            const char *color = strchr(pixel_chars, line[x]);
+            if (!color) return -1;
+            set_pixel(frame, x, height, (int) (color - pixel_chars));
+        }
+        height++;
+        start = ftell(file);
+    }
+    if (width == DISPLAY_WIDTH && height == DISPLAY_HEIGHT) return 0;
+    frame->hires = true;
+    return width == HIRES_WIDTH && height == HIRES_HEIGHT ? 0 : -1;
+}
+
+int load_golden(Golden_Set *set, const char *path) {
+    memset(set, 0, sizeof(*set));
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+    char line[MAX_LINE_LENGTH];
+    size_t capacity = 0;
+    int result = 0;
+    while (result == 0 && fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') continue;
+        unsigned long long cycles;
+        char hash[17];
+        int rom = 0;
+        if (sscanf(line, "rom %llu %16s %n", &cycles, hash, &rom) != 2 || rom == 0 || line[rom] == '\0') {
+            result = -1;
+            break;
+        }
+        if (set->count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            Golden *entries = realloc(set->entries, capacity * sizeof(Golden));
+            if (!entries) {
+                result = -1;
+                break;
+            }
+            set->entries = entries;
+        }
+        Golden *entry = &set->entries[set->count];
+        memset(entry, 0, sizeof(*entry));
+        entry->rom = malloc(strlen(line + rom) + 1);
+        if (!entry->rom) {
+            result = -1;
+            break;
+        }
+        strcpy(entry->rom, line + rom);
+        entry->cycles = cycles;
+        set->count++;
+        if (strcmp(hash, "-") != 0) {
+            entry->has_frame = true;
+            entry->hash = strtoull(hash, NULL, 16);
+            result = read_frame(file, &entry->frame);
+        }
+    }
+    fclose(file);
+    if (result == -1) free_golden(set);
+    return result;
+}
+
+int save_golden(const Golden_Set *set, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) return -1;
+    for (size_t i = 0; i < set->count; i++) {
+        const Golden *entry = &set->entries[i];
+        if (!entry->has_frame) {
+            fprintf(file, "rom %llu - %s\n", entry->cycles, entry->rom);
+            continue;
+        }
+        fprintf(file, "rom %llu %016" PRIx64 " %s\n", entry->cycles, entry->hash, entry->rom);
+        const Display *frame = &entry->frame;
+        for (int y = 0; y < display_height(frame); y++) {
+            for (int x = 0; x < display_width(frame); x++) fputc(pixel_chars[get_pixel(frame, x, y)], file);
+            fputc('\n', file);
+        }
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+void free_golden(Golden_Set *set) {
+    for (size_t i = 0; i < set->count; i++) free(set->entries[i].rom);
+    free(set->entries);
+    set->entries = NULL;
+    set->count = 0;
+}
+
+bool same_frame(const Display *a, const Display *b) {
+    if (a->hires != b->hires) return false;
+    for (int y = 0; y < display_height(a); y++) {
+        for (int x = 0; x < display_width(a); x++) {
+            if (get_pixel(a, x, y) != get_pixel(b, x, y)) return false;
+        }
+    }
+    return true;
+}
+
+int write_pbm(const Display *display, const Display *other, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) return -1;
+    // a diff of two resolutions covers the larger one
+    bool hires = display->hires || (other && other->hires);
+    int width = hires ? HIRES_WIDTH : DISPLAY_WIDTH;
+    int height = hires ? HIRES_HEIGHT : DISPLAY_HEIGHT;
+    fprintf(file, "P1\n%d %d\n", width, height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            bool inside = x < display_width(display) && y < display_height(display);
+            int color = inside ? get_pixel(display, x, y) : 0;
+            if (other) {
+                bool other_inside = x < display_width(other) && y < display_height(other);
+                color = color != (other_inside ? get_pixel(other, x, y) : 0);
+            }
+            fputc(color ? '1' : '0', file);
+        }
+        fputc('\n', file);
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
@@ -0,0 +1,38 @@
+#ifndef CHIP_8_GOLDEN_H
+#define CHIP_8_GOLDEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "chip8.h"
+
+// golden frames: the display a rom shows after a fixed number of instructions, stored as text so a
+// changed frame shows up in a diff. one entry per rom, paths are relative to the golden file:
+//   rom <cycles> <display hash | -> <rom path>
+//   <one line per display row, . # + * for the colours 0 to 3>
+// an entry with - as hash has no frame yet, it gets one when the file is refreshed
+
+typedef struct Golden {
+    char *rom;
+    unsigned long long cycles;
+    bool has_frame; // false until the file is refreshed
+    uint64_t hash; // display_hash() of the frame
+    Display frame;
+} Golden;
+
+typedef struct Golden_Set {
+    Golden *entries;
+    size_t count;
+} Golden_Set;
+
+// returns -1 if the file can't be read or is malformed
+int load_golden(Golden_Set *set, const char *path);
+int save_golden(const Golden_Set *set, const char *path);
+void free_golden(Golden_Set *set);
+
+// true if both show the same pixels at the same resolution
+bool same_frame(const Display *a, const Display *b);
+// writes a frame as plain PBM, set pixels are black. with `other` the image shows the pixels that differ
+int write_pbm(const Display *display, const Display *other, const char *path);
+
+#endif //CHIP_8_GOLDEN_H
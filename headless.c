@@ -0,0 +1,540 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chip8.h"
+#include "snapshot.h"
+#include "batch.h"
+#include "movie.h"
+#include "library.h"
+#include "golden.h"
+#include "capture.h"
+#include "trace.h"
+#include "analyze.h"
+#include "disasm.h"
+
+// runs a rom without display or audio for a fixed budget, as fast as the host allows.
+// the timers are ticked every `cycles per frame` instructions instead of by wall clock.
+//
+// usage: Chip_8_headless <rom|library.c8l> [-c cycles] [-f frames] [-i cycles-per-frame] [-e interpreter|cache|blocks] [-q quirks] [-l state] [-s state] [-b instances] [-t threads] [-p movie] [-x seed] [-m chip8|schip|xo]
+// -e picks the execution engine, default is the decode cache. -q takes a comma separated list of
+// quirk profiles (chip8, vip, schip, xo) and quirks (clip, shift, keep-i, jump-vx, vf-reset, display-wait), by default
+// the profile follows the machine.
+// -l restores a snapshot before running, -s saves one after the run.
+// -b runs that many copies of the machine across -t worker threads, each with its own random seed.
+// -p replays a movie recorded by the frontend with its seed and cycles per frame, for as many frames as
+// were recorded unless -c or -f is given. -x seeds the random number generator (hex).
+// -m picks the machine, by default it follows the extension of the rom (.sc8 SCHIP, .xo8 XO-CHIP).
+// -o records the display of every frame to a Y4M video and -w the sound to a WAV file (see capture.h),
+// emulation waits for the encoder when it falls behind so no frame is lost.
+// -T writes an execution trace (see trace.h) when built with CHIP8_TRACE, without dropping records.
+// -a decodes the code found by the static analysis before the first frame instead of when it first runs,
+// it doesn't combine with -b.
+// a library (.c8l) runs every rom it holds with the machine, quirks and cycles per frame stored for it,
+// -i and -q override them. prints the executed cycles, frames and a hash of the final display of every rom
+// and exits with 0 on success or when the rom exited with 00FD, 1 if a rom hit an unknown opcode or
+// called past the end of the stack or returned with an empty one.
+//
+// Chip_8_headless -P <directory> <library.c8l> packs the roms below a directory into a library.
+// Chip_8_headless -V <golden.txt> [-e engine] runs the roms of a golden file (see golden.h) on every engine,
+// or the given one, and compares their final frames. a mismatch writes the frame and its difference to the
+// golden frame as PBM images to the working directory and exits with 1.
+// Chip_8_headless -G <golden.txt> stores the frames the interpreter ends on as the new golden frames.
+// Chip_8_headless -A <rom> prints the basic blocks, sprites and data found by the static analysis (see analyze.h).
+
+static void usage() {
+    printf("usage: Chip_8_headless <rom|library.c8l> [-c cycles] [-f frames] [-i cycles-per-frame] [-e interpreter|cache|blocks] [-q quirks] [-l state] [-s state] [-b instances] [-t threads] [-p movie] [-x seed] [-m chip8|schip|xo] [-o video.y4m] [-w audio.wav] [-T trace] [-a]\n");
+    printf("       Chip_8_headless -P <directory> <library.c8l>\n");
+    printf("       Chip_8_headless -V <golden.txt> [-e interpreter|cache|blocks]\n");
+    printf("       Chip_8_headless -G <golden.txt>\n");
+    printf("       Chip_8_headless -A <rom>\n");
+}
+
+static const char *engine_names[] = {"interpreter", "cache", "blocks"};
+
+static Analysis_Cache analyses; // for -a, kept per rom
+
+// returns -1 for an unknown engine
+static int parse_engine(const char *name, Engine_Type *type) {
+    for (int i = ENGINE_INTERPRETER; i <= ENGINE_BLOCKS; i++) {
+        if (strcmp(name, engine_names[i]) == 0) {
+            *type = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+#ifdef CHIP8_PROFILE
+static Profile profile;
+#endif
+
+static void apply_quirks(Chip_8 *chip, const char *quirk_names) {
+    if (!quirk_names) return;
+    uint8_t quirks = chip->quirks;
+    parse_quirks(quirk_names, &quirks);
+    set_quirks(chip, quirks);
+}
+
+// runs frames until the budget is used up or the rom halts, `movie` is NULL if no input is replayed
+// and `capture` if nothing is recorded
+static void run_frames(Chip_8 *chip, Engine *engine, unsigned int cycles_per_frame, unsigned long long max_cycles,
+                       unsigned long long max_frames, Movie *movie, Capture *capture, unsigned long long *cycles,
+                       unsigned long long *frames) {
+    *cycles = 0;
+    *frames = 0;
+    while (!chip->halted) {
+        if (max_frames && *frames >= max_frames) break;
+        if (max_cycles && *cycles >= max_cycles) break;
+
+        unsigned int budget = cycles_per_frame;
+        if (max_cycles && max_cycles - *cycles < budget) budget = (unsigned int) (max_cycles - *cycles);
+        if (movie) replay_frame(movie, chip, (uint32_t) *frames);
+        PROFILE_BEGIN(start);
+        *cycles += run_frame(chip, engine, budget);
+        PROFILE_END(chip->profile, PROFILE_EMULATE, start);
+        (*frames)++;
+        if (capture) {
+            capture_frame(capture, chip, *frames);
+            chip->audio_flag = false;
+        }
+    }
+}
+
+// appended to the result line, 00FD ends a run normally while the other reasons make it fail
+static const char *halt_reason(const Chip_8 *chip) {
+    if (!chip->halted) return "";
+    switch (chip->halt_reason) {
+        case HALT_EXIT: return " exited";
+        case HALT_STACK_OVERFLOW: return " halted stack-overflow";
+        case HALT_STACK_UNDERFLOW: return " halted stack-underflow";
+        default: return " halted";
+    }
+}
+
+static bool failed(const Chip_8 *chip) {
+    return chip->halted && chip->halt_reason != HALT_EXIT;
+}
+
+static bool is_library(const char *path) {
+    const char *extension = strrchr(path, '.');
+    return extension && strcmp(extension, ".c8l") == 0;
+}
+
+// runs a rom of a golden file for its cycles with the defaults of its machine,
+// returns -1 if it can't be loaded
+static int run_golden(const char *golden_path, const Golden *entry, Chip_8 *chip, Engine *engine, Engine_Type type) {
+    // rom paths are relative to the golden file
+    const char *slash = strrchr(golden_path, '/');
+    int directory = slash ? (int) (slash - golden_path + 1) : 0;
+    char path[1024];
+    snprintf(path, sizeof(path), "%.*s%s", directory, golden_path, entry->rom);
+
+    init_chip(chip);
+    set_machine(chip, machine_from_path(path));
+    if (load_program_to_memory(chip, path) == -1) return -1;
+#ifdef CHIP8_PROFILE
+    chip->profile = &profile;
+#endif
+    init_engine(engine, type);
+    unsigned long long cycles, frames;
+    run_frames(chip, engine, CYCLES_PER_FRAME, entry->cycles, 0, NULL, NULL, &cycles, &frames);
+    return 0;
+}
+
+// compares the final frames of the roms of a golden file with the stored ones on the engines
+// `first` to `last`. returns the number of mismatches or -1 if the golden file can't be read
+static int verify_golden(const char *golden_path, Engine_Type first, Engine_Type last) {
+    Golden_Set set;
+    if (load_golden(&set, golden_path) == -1) return -1;
+    static Engine engine;
+    static Chip_8 chip;
+    int failures = 0;
+    for (size_t i = 0; i < set.count; i++) {
+        const Golden *entry = &set.entries[i];
+        if (!entry->has_frame) {
+            printf("%s: no golden frame, refresh the file with -G\n", entry->rom);
+            failures++;
+            continue;
+        }
+        for (Engine_Type type = first; type <= last; type++) {
+            if (run_golden(golden_path, entry, &chip, &engine, type) == -1) {
+                printf("%s: can't be loaded\n", entry->rom);
+                failures++;
+                break;
+            }
+            uint64_t hash = display_hash(&chip);
+            if (hash == entry->hash && same_frame(&chip.display, &entry->frame)) {
+                printf("%s: ok on %s\n", entry->rom, engine_names[type]);
+                continue;
+            }
+            failures++;
+            // the images are named after the rom, without its directories
+            const char *name = strrchr(entry->rom, '/') ? strrchr(entry->rom, '/') + 1 : entry->rom;
+            char actual[1024], diff[1024];
+            snprintf(actual, sizeof(actual), "%s.%s.pbm", name, engine_names[type]);
+            snprintf(diff, sizeof(diff), "%s.%s.diff.pbm", name, engine_names[type]);
+            write_pbm(&chip.display, NULL, actual);
+            write_pbm(&chip.display, &entry->frame, diff);
+            printf("%s: FAILED on %s, hash=%016llx expected %016llx, see %s and %s\n", entry->rom, engine_names[type],
+                   (unsigned long long) hash, (unsigned long long) entry->hash, actual, diff);
+        }
+    }
+    printf("%s: %zu roms, %d failed\n", golden_path, set.count, failures);
+    free_golden(&set);
+    return failures;
+}
+
+// stores the frames the interpreter ends on in the golden file
+static int refresh_golden(const char *golden_path) {
+    Golden_Set set;
+    if (load_golden(&set, golden_path) == -1) return -1;
+    static Engine engine;
+    static Chip_8 chip;
+    int result = 0;
+    for (size_t i = 0; i < set.count && result == 0; i++) {
+        Golden *entry = &set.entries[i];
+        if (run_golden(golden_path, entry, &chip, &engine, ENGINE_INTERPRETER) == -1) {
+            printf("%s: can't be loaded\n", entry->rom);
+            result = -1;
+            break;
+        }
+        entry->has_frame = true;
+        entry->hash = display_hash(&chip);
+        entry->frame = chip.display;
+        printf("%s: hash=%016llx\n", entry->rom, (unsigned long long) entry->hash);
+    }
+    if (result == 0) result = save_golden(&set, golden_path);
+    free_golden(&set);
+    return result;
+}
+
+// prints the ranges of consecutive addresses that have `flag` set
+static void print_ranges(const Rom_Analysis *analysis, const Chip_8 *chip, uint8_t flag, const char *name) {
+    for (unsigned int address = 0x200; address <= chip->address_mask; address++) {
+        if (!(analysis->flags[address] & flag)) continue;
+        unsigned int first = address;
+        while (address < chip->address_mask && analysis->flags[address + 1] & flag) address++;
+        printf("%s %03X-%03X\n", name, first, address);
+    }
+}
+
+// lists the basic blocks of a rom with their successors and disassembly, followed by its sprites and data
+static int print_analysis(char *path) {
+    static Chip_8 chip;
+    static Rom_Analysis analysis;
+    init_chip(&chip);
+    set_machine(&chip, machine_from_path(path));
+    int size = load_program_to_memory(&chip, path);
+    if (size == -1) return -3;
+    analyze_rom(&chip, &analysis);
+
+    int code = 0;
+    for (unsigned int address = 0x200; address < 0x200u + size; address++)
+        if (analysis.flags[address] & BYTE_CODE) code++;
+    printf("%s: %d of %d bytes are code in %u blocks%s\n", path, code, size, analysis.block_count,
+           analysis.partial ? ", some targets are unknown" : "");
+    for (unsigned int i = 0; i < analysis.block_count; i++) {
+        const Code_Block *block = &analysis.blocks[i];
+        printf("block %03X-%03X ->", block->start, block->end - 1);
+        for (int j = 0; j < block->next_count; j++) printf(" %03X", block->next[j]);
+        printf("\n");
+        for (uint16_t address = block->start; address != block->end;) {
+            char text[32];
+            uint16_t opcode = fetch_opcode(&chip, address);
+            int length = disassemble(opcode, fetch_opcode(&chip, address + 2), text, sizeof(text));
+            printf("  %03X  %04X  %s%s\n", address, opcode, text,
+                   analysis.flags[address] & BYTE_WRITTEN ? "  ; modified by the program" : "");
+            address = (address + length) & chip.address_mask;
+        }
+    }
+    print_ranges(&analysis, &chip, BYTE_SPRITE, "sprite");
+    print_ranges(&analysis, &chip, BYTE_DATA, "data");
+    print_ranges(&analysis, &chip, BYTE_WRITTEN, "written");
+    return 0;
+}
+
+// runs every rom of a library one after another, `cycles_per_frame` is 0 to use the one of each rom
+static int run_library(const char *path, Engine_Type engine_type, const char *quirk_names, unsigned int cycles_per_frame,
+                       unsigned long long max_cycles, unsigned long long max_frames, uint32_t seed, bool analyze) {
+    Rom_Library library;
+    if (open_library(&library, path) == -1) return -8;
+    static Engine engine;
+    static Chip_8 chip;
+    int result = 0;
+    for (uint32_t i = 0; i < library.count; i++) {
+        Rom_Entry entry;
+        if (library_entry(&library, i, &entry) == -1) {
+            printf("%s: entry %u is damaged\n", path, i);
+            result = -8;
+            break;
+        }
+        init_chip(&chip);
+        if (load_rom_entry(&chip, &entry) == -1) {
+            printf("%s: too large for its machine\n", entry.name);
+            continue;
+        }
+        apply_quirks(&chip, quirk_names);
+        seed_random(&chip, seed);
+#ifdef CHIP8_PROFILE
+        chip.profile = &profile;
+#endif
+        init_engine(&engine, engine_type);
+        if (analyze) predecode_rom(lookup_analysis(&analyses, &chip), &chip, &engine);
+
+        unsigned int frame_cycles = cycles_per_frame ? cycles_per_frame : entry.cycles_per_frame;
+        unsigned long long cycles, frames;
+        run_frames(&chip, &engine, frame_cycles, max_cycles, max_frames, NULL, NULL, &cycles, &frames);
+        printf("%s: cycles=%llu frames=%llu pc=0x%03X hash=%016llx%s\n", entry.name, cycles, frames, chip.PC,
+               (unsigned long long) display_hash(&chip), halt_reason(&chip));
+        if (failed(&chip) && result == 0) result = 1;
+    }
+    close_library(&library);
+    return result;
+}
+
+// runs copies of `chip` in a batch and prints how many distinct displays they ended up with
+static int run_batch(const char *rom, const Chip_8 *chip, unsigned int instances, unsigned int threads,
+                     unsigned int cycles_per_frame, unsigned long long cycles) {
+    Chip8_Batch *batch = chip8_batch_create(instances, threads);
+    if (!batch) return -6;
+    chip8_batch_set_cycles_per_frame(batch, cycles_per_frame);
+    chip8_batch_set_machine(batch, chip->machine);
+    for (unsigned int i = 0; i < instances; i++) {
+        Chip_8 *machine = chip8_batch_machine(batch, i);
+        *machine = *chip;
+        seed_random(machine, chip->rng + i * 0x9E3779B9u);
+#ifdef CHIP8_PROFILE
+        machine->profile = NULL; // the counters aren't shared between threads
+#endif
+    }
+    chip8_batch_set_quirks(batch, chip->quirks);
+
+    // step in slices of one emulated second so the cycle count fits
+    for (unsigned long long done = 0; done < cycles;) {
+        unsigned long long step = cycles - done;
+        if (step > cycles_per_frame * TIMER_HZ) step = cycles_per_frame * TIMER_HZ;
+        chip8_batch_step(batch, (unsigned int) step);
+        done += step;
+    }
+
+    unsigned int halted = 0, exited = 0, distinct = 0;
+    uint64_t *hashes = malloc(instances * sizeof(uint64_t));
+    for (unsigned int i = 0; hashes && i < instances; i++) {
+        Chip_8 *machine = chip8_batch_machine(batch, i);
+        if (failed(machine)) halted++;
+        else if (machine->halted) exited++;
+        hashes[i] = display_hash(machine);
+        bool seen = false;
+        for (unsigned int j = 0; j < i && !seen; j++) seen = hashes[j] == hashes[i];
+        if (!seen) distinct++;
+    }
+    printf("%s: instances=%u cycles=%llu hash=%016llx distinct=%u halted=%u exited=%u\n", rom, instances, cycles,
+           (unsigned long long) display_hash(chip8_batch_machine(batch, 0)), distinct, halted, exited);
+    free(hashes);
+    chip8_batch_destroy(batch);
+    return halted ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        usage();
+        return -1; // return if no rom is provided
+    }
+    if (strcmp(argv[1], "-P") == 0) {
+        if (argc != 4) {
+            usage();
+            return -1;
+        }
+        int packed = build_library(argv[2], argv[3]);
+        if (packed == -1) {
+            printf("could not pack %s into %s\n", argv[2], argv[3]);
+            return -8;
+        }
+        printf("%s: %d roms\n", argv[3], packed);
+        return 0;
+    }
+    if (strcmp(argv[1], "-A") == 0) {
+        if (argc != 3) {
+            usage();
+            return -1;
+        }
+        return print_analysis(argv[2]);
+    }
+    if (strcmp(argv[1], "-V") == 0 || strcmp(argv[1], "-G") == 0) {
+        Engine_Type first = ENGINE_INTERPRETER, last = ENGINE_BLOCKS;
+        bool verify = argv[1][1] == 'V';
+        if (verify && argc == 5 && strcmp(argv[3], "-e") == 0 && parse_engine(argv[4], &first) == 0) last = first;
+        else if (argc != 3) {
+            usage();
+            return -1;
+        }
+#ifdef CHIP8_PROFILE
+        init_profile(&profile, CYCLES_PER_FRAME * TIMER_HZ);
+#endif
+        int result = verify ? verify_golden(argv[2], first, last) : refresh_golden(argv[2]);
+        if (result == -1) {
+            printf("could not %s %s\n", verify ? "read" : "refresh", argv[2]);
+            return -9;
+        }
+        return result ? 1 : 0;
+    }
+
+    unsigned long long max_cycles = 0;
+    unsigned long long max_frames = 0;
+    unsigned int cycles_per_frame = 0; // CYCLES_PER_FRAME unless given or stored with the rom
+    Engine_Type engine_type = ENGINE_DECODE_CACHE;
+    const char *quirk_names = NULL;
+    const char *load_path = NULL;
+    const char *save_path = NULL;
+    unsigned int instances = 0;
+    unsigned int threads = 0;
+    const char *movie_path = NULL;
+    const char *video_path = NULL;
+    const char *audio_path = NULL;
+    const char *trace_path = NULL;
+    bool analyze = false;
+    uint32_t seed = RNG_SEED;
+    Machine machine = machine_from_path(argv[1]);
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-a") == 0) {
+            analyze = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage();
+            return -1;
+        }
+        if (strcmp(argv[i], "-c") == 0) max_cycles = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-f") == 0) max_frames = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-i") == 0) cycles_per_frame = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-l") == 0) load_path = argv[++i];
+        else if (strcmp(argv[i], "-s") == 0) save_path = argv[++i];
+        else if (strcmp(argv[i], "-b") == 0) instances = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-t") == 0) threads = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-p") == 0) movie_path = argv[++i];
+        else if (strcmp(argv[i], "-x") == 0) seed = strtoul(argv[++i], NULL, 16);
+        else if (strcmp(argv[i], "-o") == 0) video_path = argv[++i];
+        else if (strcmp(argv[i], "-w") == 0) audio_path = argv[++i];
+        else if (strcmp(argv[i], "-T") == 0) trace_path = argv[++i];
+        else if (strcmp(argv[i], "-q") == 0) {
+            // checked here, applied on top of the profile of the machine once that is known
+            uint8_t quirks = 0;
+            quirk_names = argv[++i];
+            if (parse_quirks(quirk_names, &quirks) == -1) {
+                usage();
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-m") == 0) {
+            i++;
+            if (strcmp(argv[i], "chip8") == 0) machine = MACHINE_CHIP8;
+            else if (strcmp(argv[i], "schip") == 0) machine = MACHINE_SCHIP;
+            else if (strcmp(argv[i], "xo") == 0) machine = MACHINE_XO_CHIP;
+            else {
+                usage();
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-e") == 0) {
+            if (parse_engine(argv[++i], &engine_type) == -1) {
+                usage();
+                return -1;
+            }
+        } else {
+            usage();
+            return -1;
+        }
+    }
+    // movies replay, captures and traces record a single machine. the machines of a batch share an opcode
+    // table decoded up front, there is nothing left for -a to decode
+    if ((movie_path || video_path || audio_path || trace_path || analyze) && instances) {
+        usage();
+        return -1;
+    }
+    if (is_library(argv[1])) {
+        if (movie_path || instances || load_path || save_path || video_path || audio_path || trace_path) {
+            usage();
+            return -1;
+        }
+        // default budget: 10 seconds of emulated time
+        if (max_cycles == 0 && max_frames == 0) max_frames = 10 * TIMER_HZ;
+#ifdef CHIP8_PROFILE
+        init_profile(&profile, CYCLES_PER_FRAME * TIMER_HZ);
+#endif
+        int result = run_library(argv[1], engine_type, quirk_names, cycles_per_frame, max_cycles, max_frames, seed,
+                                 analyze);
+#ifdef CHIP8_PROFILE
+        dump_profile(&profile, stderr);
+#endif
+        return result;
+    }
+
+    Chip_8 chip;
+    init_chip(&chip);
+    set_machine(&chip, machine);
+    if (load_program_to_memory(&chip, argv[1]) == -1) return -3;
+    apply_quirks(&chip, quirk_names);
+
+    static Movie movie;
+    if (movie_path) {
+        if (load_movie(&movie, movie_path) == -1) return -7;
+        if (movie.program != program_hash(&chip)) printf("%s: movie was recorded with a different rom\n", argv[1]);
+        seed = movie.seed;
+        cycles_per_frame = movie.cycles_per_frame;
+        if (max_cycles == 0 && max_frames == 0) max_frames = movie.frames;
+    }
+    seed_random(&chip, seed);
+
+    // default budget: 10 seconds of emulated time
+    if (max_cycles == 0 && max_frames == 0) max_frames = 10 * TIMER_HZ;
+    if (cycles_per_frame == 0) cycles_per_frame = CYCLES_PER_FRAME;
+    if (load_path && load_state_file(&chip, load_path) == -1) return -4;
+    if (instances) {
+        unsigned long long budget = max_cycles ? max_cycles : max_frames * cycles_per_frame;
+        return run_batch(argv[1], &chip, instances, threads, cycles_per_frame, budget);
+    }
+
+    static Engine engine;
+    init_engine(&engine, engine_type);
+    if (analyze) predecode_rom(lookup_analysis(&analyses, &chip), &chip, &engine);
+#ifdef CHIP8_PROFILE
+    init_profile(&profile, cycles_per_frame * TIMER_HZ);
+    chip.profile = &profile;
+#endif
+#ifdef CHIP8_TRACE
+    if (trace_path && !(chip.trace = open_trace(trace_path, true))) {
+        printf("could not create trace %s\n", trace_path);
+        return -11;
+    }
+#else
+    if (trace_path) printf("built without CHIP8_TRACE, no trace is written\n");
+#endif
+    Capture *capture = NULL;
+    if ((video_path || audio_path) && !(capture = open_capture(video_path, audio_path, true))) {
+        printf("could not create the capture\n");
+        return -10;
+    }
+
+    unsigned long long cycles, frames;
+    run_frames(&chip, &engine, cycles_per_frame, max_cycles, max_frames, movie_path ? &movie : NULL, capture,
+               &cycles, &frames);
+    if (capture && close_capture(capture) == -1) {
+        printf("could not write the capture\n");
+        return -10;
+    }
+#ifdef CHIP8_TRACE
+    if (chip.trace && close_trace(chip.trace) == -1) {
+        printf("could not write trace %s\n", trace_path);
+        return -11;
+    }
+#endif
+
+    free_movie(&movie);
+    if (save_path && save_state_file(&chip, save_path) == -1) return -5;
+
+    printf("%s: cycles=%llu frames=%llu pc=0x%03X hash=%016llx%s\n", argv[1], cycles, frames, chip.PC,
+           (unsigned long long) display_hash(&chip), halt_reason(&chip));
+#ifdef CHIP8_PROFILE
+    dump_profile(&profile, stderr);
+#endif
+    return failed(&chip) ? 1 : 0;
+}
@@ -0,0 +1,52 @@
+#include <string.h>
+#include "instance.h"
+
+void chip8_init(Chip8_Instance *instance, Machine machine, Engine_Type engine, const Chip8_Callbacks *callbacks) {
+    init_chip(&instance->chip);
+    set_machine(&instance->chip, machine);
+    init_engine(&instance->engine, engine);
+    init_synth(&instance->synth);
+    if (callbacks) instance->callbacks = *callbacks;
+    else memset(&instance->callbacks, 0, sizeof(instance->callbacks));
+    instance->cycles_per_frame = CYCLES_PER_FRAME;
+    instance->beeping = false;
+    instance->cycles = 0;
+    instance->frames = 0;
+}
+
+int chip8_load(Chip8_Instance *instance, const uint8_t *rom, size_t size) {
+    return load_program(&instance->chip, rom, size);
+}
+
+void chip8_set_key(Chip8_Instance *instance, int key, bool pressed) {
+    set_key(&instance->chip, key, pressed);
+}
+
+unsigned int chip8_step(Chip8_Instance *instance) {
+    if (instance->chip.halted) return 0;
+    unsigned int executed = run_engine(&instance->chip, &instance->engine, 1);
+    instance->cycles += executed;
+    return executed;
+}
+
+unsigned int chip8_run_frame(Chip8_Instance *instance) {
+    Chip_8 *chip = &instance->chip;
+    unsigned int executed = run_frame(chip, &instance->engine, instance->cycles_per_frame);
+    instance->cycles += executed;
+    instance->frames++;
+
+    const Chip8_Callbacks *callbacks = &instance->callbacks;
+    if (callbacks->frame) {
+        Dirty_Region dirty = {0};
+        take_dirty(chip, &dirty);
+        if (dirty.rows) callbacks->frame(callbacks->user, &chip->display, &dirty);
+    }
+    if (callbacks->audio) {
+        int16_t samples[FRAME_SAMPLES];
+        update_tone(&instance->synth, chip, instance->frames, &instance->beeping);
+        render_audio(&instance->synth, samples, FRAME_SAMPLES);
+        callbacks->audio(callbacks->user, samples, FRAME_SAMPLES);
+    }
+    chip->audio_flag = false;
+    return executed;
+}
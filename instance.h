@@ -0,0 +1,43 @@
+#ifndef CHIP_8_INSTANCE_H
+#define CHIP_8_INSTANCE_H
+
+#include "chip8.h"
+#include "audio.h"
+
+// a complete emulator for embedding: machine, engine and tone generator in storage owned by the caller.
+// nothing is allocated and instances share no state, so any number of them can run side by side,
+// each on one thread at a time. the frontend gets the output of every frame through callbacks
+
+typedef struct Chip8_Callbacks {
+    // the display changed during the frame, `dirty` marks the changed pixels. NULL if the frontend polls
+    void (*frame)(void *user, const Display *display, const Dirty_Region *dirty);
+    // FRAME_SAMPLES mono samples at AUDIO_RATE after every frame. NULL skips rendering audio
+    void (*audio)(void *user, const int16_t *samples, int count);
+    void *user; // passed back to the callbacks
+} Chip8_Callbacks;
+
+// large because of the engine (about 1 MB), keep it in static or heap storage
+typedef struct Chip8_Instance {
+    Chip_8 chip; // can be used directly, e.g. for snapshots or quirks
+    Engine engine;
+    Synth synth;
+    Chip8_Callbacks callbacks;
+    unsigned int cycles_per_frame; // CYCLES_PER_FRAME by default
+    bool beeping;
+    uint64_t cycles; // emulated instructions so far
+    uint64_t frames; // emulated frames so far
+} Chip8_Instance;
+
+// resets the instance to `machine` with its quirk profile, `callbacks` may be NULL
+void chip8_init(Chip8_Instance *instance, Machine machine, Engine_Type engine, const Chip8_Callbacks *callbacks);
+// copies a rom to 0x200, returns -1 if it is empty or doesn't fit
+int chip8_load(Chip8_Instance *instance, const uint8_t *rom, size_t size);
+// `key` is the chip-8 key 0-F
+void chip8_set_key(Chip8_Instance *instance, int key, bool pressed);
+// executes a single instruction without ticking the timers, returns 0 if the machine halted
+unsigned int chip8_step(Chip8_Instance *instance);
+// runs `cycles_per_frame` instructions, ends the 60 Hz frame and calls the callbacks.
+// returns the number of executed instructions
+unsigned int chip8_run_frame(Chip8_Instance *instance);
+
+#endif //CHIP_8_INSTANCE_H
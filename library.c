@@ -0,0 +1,428 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "library.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define MAX_PATH_LENGTH 1024
+
+// fields are stored little-endian
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v) {
+    p = put_u16(p, v & 0xFFFF);
+    return put_u16(p, v >> 16);
+}
+
+static uint8_t *put_u64(uint8_t *p, uint64_t v) {
+    p = put_u32(p, v & 0xFFFFFFFF);
+    return put_u32(p, v >> 32);
+}
+
+static uint16_t get_u16(const uint8_t *p) {
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return get_u16(p) | (uint32_t) get_u16(p + 2) << 16;
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+    return get_u32(p) | (uint64_t) get_u32(p + 4) << 32;
+}
+
+uint64_t rom_hash(const uint8_t *data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// ---packing---
+
+typedef struct Rom_Settings {
+    char *name;
+    Machine machine;
+    bool has_machine;
+    char *quirks; // applied on top of the profile of the machine, NULL if not given
+    unsigned int cycles_per_frame; // 0 for the default
+    uint8_t keys[16];
+} Rom_Settings;
+
+typedef struct Packed_Rom {
+    uint64_t hash;
+    char *name;
+    uint8_t *data;
+    uint32_t size;
+    Machine machine;
+    uint8_t quirks;
+    unsigned int cycles_per_frame;
+    uint8_t keys[16];
+} Packed_Rom;
+
+typedef struct Pack {
+    Packed_Rom *roms;
+    size_t count;
+    size_t capacity;
+    Rom_Settings *settings; // sorted by name
+    size_t settings_count;
+} Pack;
+
+static char *copy_string(const char *string) {
+    char *copy = malloc(strlen(string) + 1);
+    if (copy) strcpy(copy, string);
+    return copy;
+}
+
+static int compare_settings(const void *a, const void *b) {
+    return strcmp(((const Rom_Settings *) a)->name, ((const Rom_Settings *) b)->name);
+}
+
+static int compare_roms(const void *a, const void *b) {
+    const Packed_Rom *x = a, *y = b;
+    if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+static int parse_hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// parses one line of library.txt, returns -1 if it is malformed. what was parsed up to then is kept
+// in `settings` to be freed by the caller
+static int parse_settings(char *line, Rom_Settings *settings) {
+    memset(settings, 0, sizeof(*settings));
+    for (int i = 0; i < 16; i++) settings->keys[i] = i;
+    line[strcspn(line, "\r\n")] = '\0';
+    while (*line == ' ') line++;
+    for (;;) {
+        size_t length = strcspn(line, " ");
+        char *value = memchr(line, '=', length);
+        if (!value || !line[length]) break; // the rest of the line is the file name
+        line[length] = '\0';
+        *value++ = '\0';
+        if (strcmp(line, "machine") == 0) {
+            if (strcmp(value, "chip8") == 0) settings->machine = MACHINE_CHIP8;
+            else if (strcmp(value, "schip") == 0) settings->machine = MACHINE_SCHIP;
+            else if (strcmp(value, "xo") == 0) settings->machine = MACHINE_XO_CHIP;
+            else return -1;
+            settings->has_machine = true;
+        } else if (strcmp(line, "quirks") == 0) {
+            uint8_t quirks = 0;
+            if (settings->quirks || parse_quirks(value, &quirks) == -1) return -1;
+            settings->quirks = copy_string(value);
+            if (!settings->quirks) return -1;
+        } else if (strcmp(line, "cycles") == 0) {
+            settings->cycles_per_frame = strtoul(value, NULL, 10);
+        } else if (strcmp(line, "keys") == 0) {
+            if (strlen(value) != 16) return -1;
+            for (int i = 0; i < 16; i++) {
+                int key = parse_hex_digit(value[i]);
+                if (key < 0) return -1;
+                settings->keys[i] = key;
+            }
+        } else return -1;
+        line += length + 1;
+        while (*line == ' ') line++;
+    }
+    settings->name = *line ? copy_string(line) : NULL;
+    return settings->name ? 0 : -1;
+}
+
+// reads library.txt of the packed directory if there is one
+static int read_settings(Pack *pack, const char *directory) {
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/%s", directory, LIBRARY_SETTINGS);
+    FILE *file = fopen(path, "r");
+    if (!file) return 0;
+    size_t capacity = 0;
+    char line[MAX_PATH_LENGTH];
+    int result = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (line[strspn(line, " \r\n")] == '\0' || line[0] == '#') continue;
+        if (pack->settings_count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            Rom_Settings *settings = realloc(pack->settings, capacity * sizeof(Rom_Settings));
+            if (!settings) {
+                result = -1;
+                break;
+            }
+            pack->settings = settings;
+        }
+        if (parse_settings(line, &pack->settings[pack->settings_count++]) == -1) {
+            result = -1;
+            break;
+        }
+    }
+    fclose(file);
+    if (result == 0) qsort(pack->settings, pack->settings_count, sizeof(Rom_Settings), compare_settings);
+    return result;
+}
+
+static bool is_rom(const char *name) {
+    const char *extension = strrchr(name, '.');
+    return extension && (strcmp(extension, ".ch8") == 0 || strcmp(extension, ".sc8") == 0 ||
+                         strcmp(extension, ".xo8") == 0);
+}
+
+static int add_rom(Pack *pack, const char *path, const char *name) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return -1;
+    // roms that don't fit the 64KB of XO-CHIP can't be run by any machine
+    static uint8_t buffer[MEMORY_SIZE - 512 + 1];
+    size_t size = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+    if (size == 0 || size == sizeof(buffer)) return 0;
+
+    if (pack->count == pack->capacity) {
+        size_t capacity = pack->capacity ? pack->capacity * 2 : 256;
+        Packed_Rom *roms = realloc(pack->roms, capacity * sizeof(Packed_Rom));
+        if (!roms) return -1;
+        pack->roms = roms;
+        pack->capacity = capacity;
+    }
+    Packed_Rom *rom = &pack->roms[pack->count];
+    rom->name = copy_string(name);
+    rom->data = malloc(size);
+    if (!rom->name || !rom->data) {
+        free(rom->name);
+        free(rom->data);
+        return -1;
+    }
+    memcpy(rom->data, buffer, size);
+    rom->size = (uint32_t) size;
+    rom->hash = rom_hash(rom->data, size);
+    rom->machine = machine_from_path(name);
+    rom->quirks = machine_quirks(rom->machine);
+    rom->cycles_per_frame = CYCLES_PER_FRAME;
+    for (int i = 0; i < 16; i++) rom->keys[i] = i;
+
+    Rom_Settings key = {.name = (char *) name};
+    const Rom_Settings *settings = pack->settings_count ? bsearch(&key, pack->settings, pack->settings_count,
+                                                                  sizeof(Rom_Settings), compare_settings) : NULL;
+    if (settings) {
+        if (settings->has_machine) rom->machine = settings->machine;
+        rom->quirks = machine_quirks(rom->machine);
+        if (settings->quirks) parse_quirks(settings->quirks, &rom->quirks);
+        if (settings->cycles_per_frame) rom->cycles_per_frame = settings->cycles_per_frame;
+        memcpy(rom->keys, settings->keys, sizeof(rom->keys));
+    }
+    pack->count++;
+    return 0;
+}
+
+// adds the roms of `directory` and its subdirectories, `prefix` is the path relative to the packed directory
+static int collect_roms(Pack *pack, const char *directory, const char *prefix) {
+    DIR *dir = opendir(directory);
+    if (!dir) return -1;
+    int result = 0;
+    struct dirent *item;
+    while (result == 0 && (item = readdir(dir))) {
+        if (strcmp(item->d_name, ".") == 0 || strcmp(item->d_name, "..") == 0) continue;
+        // paths that don't fit are skipped, one byte of `name` is left for the separator of a subdirectory
+        char path[MAX_PATH_LENGTH], name[MAX_PATH_LENGTH];
+        if (snprintf(path, sizeof(path), "%s/%s", directory, item->d_name) >= (int) sizeof(path) ||
+            snprintf(name, sizeof(name) - 1, "%s%s", prefix, item->d_name) >= (int) sizeof(name) - 1)
+            continue;
+        struct stat info;
+        if (stat(path, &info) != 0) continue;
+        if (S_ISDIR(info.st_mode)) {
+            strcat(name, "/");
+            result = collect_roms(pack, path, name);
+        } else if (S_ISREG(info.st_mode) && is_rom(item->d_name)) {
+            result = add_rom(pack, path, name);
+        }
+    }
+    closedir(dir);
+    return result;
+}
+
+static int write_library(const Pack *pack, const char *path) {
+    // the index is followed by the names and the data
+    uint64_t names_size = 0, data_size = 0;
+    for (size_t i = 0; i < pack->count; i++) {
+        names_size += strlen(pack->roms[i].name) + 1;
+        data_size += pack->roms[i].size;
+    }
+    uint64_t names_offset = LIBRARY_HEADER_SIZE + (uint64_t) pack->count * LIBRARY_ENTRY_SIZE;
+    uint64_t data_offset = names_offset + names_size;
+    if (data_offset + data_size > UINT32_MAX) return -1;
+
+    FILE *file = fopen(path, "wb");
+    if (!file) return -1;
+    uint8_t header[LIBRARY_HEADER_SIZE];
+    memcpy(header, LIBRARY_MAGIC, 4);
+    put_u32(put_u16(header + 4, LIBRARY_VERSION), (uint32_t) pack->count);
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+    uint32_t name = (uint32_t) names_offset, data = (uint32_t) data_offset;
+    for (size_t i = 0; ok && i < pack->count; i++) {
+        const Packed_Rom *rom = &pack->roms[i];
+        uint8_t entry[LIBRARY_ENTRY_SIZE];
+        uint8_t *p = put_u64(entry, rom->hash);
+        p = put_u32(p, data);
+        p = put_u32(p, rom->size);
+        p = put_u32(p, name);
+        *p++ = rom->machine;
+        *p++ = rom->quirks;
+        p = put_u16(p, (uint16_t) rom->cycles_per_frame);
+        memcpy(p, rom->keys, sizeof(rom->keys));
+        ok = fwrite(entry, 1, sizeof(entry), file) == sizeof(entry);
+        name += (uint32_t) strlen(rom->name) + 1;
+        data += rom->size;
+    }
+    for (size_t i = 0; ok && i < pack->count; i++) {
+        size_t length = strlen(pack->roms[i].name) + 1;
+        ok = fwrite(pack->roms[i].name, 1, length, file) == length;
+    }
+    for (size_t i = 0; ok && i < pack->count; i++) {
+        ok = fwrite(pack->roms[i].data, 1, pack->roms[i].size, file) == pack->roms[i].size;
+    }
+    if (fclose(file) != 0) ok = false;
+    return ok ? 0 : -1;
+}
+
+int build_library(const char *directory, const char *path) {
+    Pack pack = {0};
+    int result = read_settings(&pack, directory);
+    if (result == 0) result = collect_roms(&pack, directory, "");
+    if (result == 0) {
+        // sorted by hash for the lookup, copies of the same rom are dropped
+        qsort(pack.roms, pack.count, sizeof(Packed_Rom), compare_roms);
+        size_t unique = 0;
+        for (size_t i = 0; i < pack.count; i++) {
+            if (unique && pack.roms[unique - 1].hash == pack.roms[i].hash) {
+                free(pack.roms[i].name);
+                free(pack.roms[i].data);
+            } else pack.roms[unique++] = pack.roms[i];
+        }
+        pack.count = unique;
+        result = write_library(&pack, path);
+    }
+
+    for (size_t i = 0; i < pack.count; i++) {
+        free(pack.roms[i].name);
+        free(pack.roms[i].data);
+    }
+    for (size_t i = 0; i < pack.settings_count; i++) {
+        free(pack.settings[i].name);
+        free(pack.settings[i].quirks);
+    }
+    free(pack.roms);
+    free(pack.settings);
+    return result == 0 ? (int) pack.count : -1;
+}
+
+// ---lookup---
+
+int open_library(Rom_Library *library, const char *path) {
+    memset(library, 0, sizeof(*library));
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return -1;
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart >= LIBRARY_HEADER_SIZE)
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    // the view keeps the file mapped after the handles are closed
+    if (mapping) library->base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
+    if (!library->base) return -1;
+    library->size = (size_t) size.QuadPart;
+#else
+    int file = open(path, O_RDONLY);
+    if (file < 0) return -1;
+    struct stat info;
+    void *base = MAP_FAILED;
+    if (fstat(file, &info) == 0 && info.st_size >= LIBRARY_HEADER_SIZE)
+        base = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (base == MAP_FAILED) return -1;
+    library->base = base;
+    library->size = (size_t) info.st_size;
+#endif
+
+    library->count = get_u32(library->base + 6);
+    if (memcmp(library->base, LIBRARY_MAGIC, 4) != 0 || get_u16(library->base + 4) != LIBRARY_VERSION ||
+        LIBRARY_HEADER_SIZE + (uint64_t) library->count * LIBRARY_ENTRY_SIZE > library->size) {
+        close_library(library);
+        return -1;
+    }
+    return 0;
+}
+
+void close_library(Rom_Library *library) {
+    if (!library->base) return;
+#ifdef _WIN32
+    UnmapViewOfFile(library->base);
+#else
+    munmap((void *) library->base, library->size);
+#endif
+    library->base = NULL;
+    library->count = 0;
+}
+
+static inline const uint8_t *entry_at(const Rom_Library *library, uint32_t index) {
+    return library->base + LIBRARY_HEADER_SIZE + (size_t) index * LIBRARY_ENTRY_SIZE;
+}
+
+int library_entry(const Rom_Library *library, uint32_t index, Rom_Entry *entry) {
+    if (index >= library->count) return -1;
+    const uint8_t *p = entry_at(library, index);
+    uint32_t data = get_u32(p + 8);
+    uint32_t size = get_u32(p + 12);
+    uint32_t name = get_u32(p + 16);
+    if ((uint64_t) data + size > library->size || name >= library->size ||
+        !memchr(library->base + name, '\0', library->size - name) || p[20] > MACHINE_XO_CHIP)
+        return -1;
+
+    entry->hash = get_u64(p);
+    entry->data = library->base + data;
+    entry->size = size;
+    entry->name = (const char *) library->base + name;
+    entry->machine = (Machine) p[20];
+    entry->quirks = p[21];
+    entry->cycles_per_frame = get_u16(p + 22);
+    if (entry->cycles_per_frame == 0) entry->cycles_per_frame = CYCLES_PER_FRAME;
+    memcpy(entry->keys, p + 24, sizeof(entry->keys));
+    for (int i = 0; i < 16; i++) entry->keys[i] &= 0xF;
+    return 0;
+}
+
+int find_rom(const Rom_Library *library, uint64_t hash, Rom_Entry *entry) {
+    uint32_t low = 0, high = library->count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (get_u64(entry_at(library, middle)) < hash) low = middle + 1;
+        else high = middle;
+    }
+    if (low == library->count || get_u64(entry_at(library, low)) != hash) return -1;
+    return library_entry(library, low, entry);
+}
+
+int load_rom_entry(Chip_8 *chip, const Rom_Entry *entry) {
+    set_machine(chip, entry->machine);
+    if (load_program(chip, entry->data, entry->size) == -1) return -1;
+    set_quirks(chip, entry->quirks); // also drops everything decoded from the previous program
+    return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef CHIP_8_LIBRARY_H
+#define CHIP_8_LIBRARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "chip8.h"
+
+// rom library: a whole rom collection packed into one file that is memory-mapped and indexed by a
+// hash of the rom contents. every rom carries the settings it runs with, so a batch over thousands
+// of roms opens a single file instead of one per rom.
+//
+// all fields are little-endian:
+//   header   magic "C8RL", 16-bit version, 32-bit number of roms
+//   index    one entry per rom, sorted by hash:
+//            64-bit hash, 32-bit data offset, 32-bit size, 32-bit name offset,
+//            machine, quirks, 16-bit cycles per frame, 16 bytes key layout
+//   names    zero-terminated file names, relative to the packed directory
+//   data     the roms
+//
+// the settings come from an optional library.txt in the packed directory, one rom per line:
+//   [machine=chip8|schip|xo] [quirks=<see parse_quirks()>] [cycles=<n>] [keys=<16 hex digits>] <file name>
+// roms without a line run with the machine of their extension, its quirk profile and CYCLES_PER_FRAME
+
+#define LIBRARY_MAGIC "C8RL"
+#define LIBRARY_VERSION 1
+#define LIBRARY_HEADER_SIZE 10
+#define LIBRARY_ENTRY_SIZE 40
+#define LIBRARY_SETTINGS "library.txt"
+
+typedef struct Rom_Library {
+    const uint8_t *base; // the mapped file
+    size_t size;
+    uint32_t count;
+} Rom_Library;
+
+// a rom of the library, `data` and `name` point into the mapping
+typedef struct Rom_Entry {
+    uint64_t hash;
+    const uint8_t *data;
+    uint32_t size;
+    const char *name;
+    Machine machine;
+    uint8_t quirks;
+    unsigned int cycles_per_frame;
+    uint8_t keys[16]; // chip-8 key sent for each key of the frontend's keypad
+} Rom_Entry;
+
+// FNV-1a hash over the contents of a rom file
+uint64_t rom_hash(const uint8_t *data, size_t size);
+
+// packs every .ch8, .sc8 and .xo8 file below `directory` into a library at `path`, roms with the same
+// contents are stored once. returns the number of packed roms or -1 if a file can't be read or written
+int build_library(const char *directory, const char *path);
+
+// returns -1 if the file can't be mapped or isn't a library
+int open_library(Rom_Library *library, const char *path);
+void close_library(Rom_Library *library);
+// returns -1 if `index` is out of range or the entry points outside the file
+int library_entry(const Rom_Library *library, uint32_t index, Rom_Entry *entry);
+// looks up a rom by rom_hash(), returns -1 if it isn't in the library
+int find_rom(const Rom_Library *library, uint64_t hash, Rom_Entry *entry);
+
+// switches an initialised chip to the machine and quirks of the rom and loads it,
+// returns -1 if the rom doesn't fit the memory of its machine
+int load_rom_entry(Chip_8 *chip, const Rom_Entry *entry);
+
+#endif //CHIP_8_LIBRARY_H
@@ -1,93 +1,38 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <SDL.h>
-#include <SDL_mixer.h>
-#include <io.h>
-#include <math.h>
+#include "chip8.h"
+#include "sync.h"
+#include "audio.h"
+#include "rewind.h"
+#include "movie.h"
+#include "library.h"
+#include "capture.h"
+#include "trace.h"
 
 // Define the dimensions of screen
 #define SCREEN_WIDTH 640
 #define SCREEN_HEIGHT 320
-// frequency for rendering and timers
-#define FRAME_RATE 400
-#define TIMER_HZ 60
-// audio-config
-#define RATE 300100
-#define AMPLITUDE 15000
-#define FREQUENCY 440.0 // 440 Hz == A
-
-typedef struct Chip_8 {
-    uint8_t memory[4096]; // 4KB memory
-    unsigned short opcode;
-    // registers
-    uint8_t V[16]; // general purpose 8-bit registers
-    uint16_t I; // 16-bit register for memory addresses
-
-    // special registers
-    uint8_t delay_register;
-    uint8_t sound_register;
-
-    // pointer & addresses
-    uint16_t PC; // program counter
-    uint8_t SP; // stack pointer
-    uint16_t stack[16]; // stack used to store addresses for subroutines
-
-    // keyboard
-    uint8_t key[16];
-
-    // display - top-left (0,0) to bottom-right (63,31)
-    bool display[64 * 32]; // pixels are either on or off
-    bool draw_flag;
-    bool key_pressed;
-} Chip_8;
-
-void initialise_key_states(Chip_8 *chip) {
-    for (int i = 0; i < 16; i++) {
-        chip->key[i] = 0;
-    }
-}
-
-Chip_8 init_chip() {
-    // allocate and initialise variables
-    Chip_8 *chip = (Chip_8 *) calloc(1, sizeof(Chip_8));
-    chip->opcode = 0;
-    chip->I = 0;
-    chip->SP = 0;
-    chip->PC = 0x200; // 0x200 is where the program is loaded to
-    chip->draw_flag = false;
-    chip->key_pressed = false;
-    memset(chip->memory, 0, sizeof(chip->memory));
-
-    initialise_key_states(chip);
-
-    // load font-set
-    unsigned char font_set[80] =
-            {
-                    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-                    0x20, 0x60, 0x20, 0x20, 0x70, // 1
-                    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-                    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-                    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-                    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-                    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-                    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-                    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-                    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-                    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-                    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-                    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-                    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-                    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-                    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-            };
-    for (int i = 0; i < 80; i++)
-        chip->memory[i] = font_set[i]; // loaded into beginning of memory
-
-    return *chip;
-}
-
-int init_graphics(SDL_Window **window, SDL_Renderer **renderer) {
+// frames the scheduler runs back to back to catch up before it skips ahead
+#define MAX_CATCHUP_FRAMES 5
+
+#ifdef CHIP8_PROFILE
+static Profile profile; // counters of the emulation thread, host timings of every thread
+#endif
+
+// window, renderer and the streaming texture the display is expanded into
+typedef struct Screen {
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    SDL_Texture *texture; // HIRES_WIDTH x HIRES_HEIGHT, the visible part is upscaled by the GPU
+    Display shown; // display contents of the texture
+    bool uploaded;
+} Screen;
+
+int init_graphics(Screen *screen) {
     // initialise SDL
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) < 0) {
         printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
@@ -95,470 +40,432 @@ int init_graphics(SDL_Window **window, SDL_Renderer **renderer) {
     }
 
     // initialise window
-    *window = SDL_CreateWindow("Chip-8 Emulator", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH,
-                               SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
-    if (window == NULL) {
+    screen->window = SDL_CreateWindow("Chip-8 Emulator", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                      SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+    if (screen->window == NULL) {
         printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
         return 1;
     }
 
-    // initialise renderer
-    *renderer = SDL_CreateRenderer(*window, -1, SDL_RENDERER_ACCELERATED);
-    if (renderer == NULL) {
+    // initialise renderer, presenting is synchronised with the host's refresh rate
+    screen->renderer = SDL_CreateRenderer(screen->window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (screen->renderer == NULL) {
         printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
         return 1;
     }
+
+    // initialise texture
+    screen->texture = SDL_CreateTexture(screen->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                        HIRES_WIDTH, HIRES_HEIGHT);
+    if (screen->texture == NULL) {
+        printf("Texture could not be created! SDL_Error: %s\n", SDL_GetError());
+        return 1;
+    }
+    memset(&screen->shown, 0, sizeof(screen->shown));
+    screen->uploaded = false;
     return 0;
 }
 
-void close_graphics(SDL_Window *window, SDL_Renderer *renderer) {
-    // Destroy window and renderer & quit
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
+void close_graphics(Screen *screen) {
+    // Destroy texture, window and renderer & quit
+    SDL_DestroyTexture(screen->texture);
+    SDL_DestroyRenderer(screen->renderer);
+    SDL_DestroyWindow(screen->window);
     SDL_Quit();
 }
 
-// Function to draw the boolean array
-void drawDisplay(SDL_Renderer *renderer, Chip_8 *chip) {
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-
-    int pixelWidth = SCREEN_WIDTH / 64;
-    int pixelHeight = SCREEN_HEIGHT / 32;
-
-    for (int x = 0; x < 64; x++) {
-        for (int y = 0; y < 32; y++) {
-            if (chip->display[y * 64 + x]) {
-                // Scale the pixel coordinates to fit the window dimensions
-                int scaledX = x * pixelWidth;
-                int scaledY = y * pixelHeight;
-
-                // Draw a filled rectangle (pixel) at the scaled coordinates
-                SDL_Rect pixelRect = {scaledX, scaledY, pixelWidth, pixelHeight};
-                SDL_RenderFillRect(renderer, &pixelRect);
-            }
-        }
+// expands the rows of the packed display that differ from the texture into it, one 32-bit pixel per pixel.
+// returns false if nothing changed
+bool update_texture(Screen *screen, const Display *display) {
+    // frames the render thread didn't pick up are gone, so the changes are taken from the texture contents
+    Dirty_Region changed = {0};
+    Dirty_Rect rect = {0, 0, display_width(display), display_height(display)};
+    // the first upload is the whole display, there is nothing to compare it with yet
+    if (screen->uploaded) {
+        diff_display(&screen->shown, display, &changed);
+        if (!dirty_rect(&changed, display, &rect)) return false;
     }
-}
 
-// open rom file and load into memory array (at index 512)
-int load_program_to_memory(Chip_8 *chip, char *path) {
-    FILE *file = fopen(path, "rb"); // it took me quite a while to figure out you need to use 'rb'
-    if (!file) return -1;
-    size_t read = fread(&chip->memory[512], 1, 3584, file);
-    fclose(file);
-    if (read == 0) return -1;
-    return 0;
+    // whole rows are uploaded, a row of the texture is only 512 bytes
+    SDL_Rect rows = {0, rect.y, display_width(display), rect.height};
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(screen->texture, &rows, &pixels, &pitch) < 0) return false;
+    expand_display_rows(display, rect.y, rect.height, pixels, pitch);
+    SDL_UnlockTexture(screen->texture);
+    memcpy(&screen->shown, display, sizeof(screen->shown));
+    screen->uploaded = true;
+    return true;
 }
 
-void draw(SDL_Renderer **renderer, Chip_8 *chip) {
-    // Clear the screen
-    SDL_SetRenderDrawColor(*renderer, 0, 0, 0, 255);
-    SDL_RenderClear(*renderer);
+// presents the display, skipped if it didn't change since the last present
+void draw(Screen *screen, const Display *display) {
+    if (!update_texture(screen, display)) return;
 
-    // Draw the boolean array
-    drawDisplay(*renderer, chip);
+    // only the top-left corner of the texture is used in low resolution
+    SDL_Rect visible = {0, 0, display_width(display), display_height(display)};
+    SDL_RenderClear(screen->renderer);
+    SDL_RenderCopy(screen->renderer, screen->texture, &visible, NULL);
     // Update the screen
-    SDL_RenderPresent(*renderer);
-}
-
-void clear_display(Chip_8 *chip) {
-    for (int i = 0; i < 32 * 64; i++) {
-        chip->display[i] = false;
-    }
+    SDL_RenderPresent(screen->renderer);
 }
 
-void decode_and_execute(Chip_8 *chip) {
-    unsigned short opcode = chip->opcode;
-    switch (opcode >> 12) {
-        case 0x0:
-            switch (opcode & 0x000F) {
-                case 0x0000: // 0x00E0: Clears the screen
-                    clear_display(chip);
-                    chip->draw_flag = true;
-                    chip->PC += 2;
-                    break;
-                case 0x000E: // 0x00EE: Returns from subroutine
-                    chip->SP--;
-                    chip->PC = chip->stack[chip->SP];
-                    chip->PC += 2;
-                    break;
-
-                default:
-                    printf("No such opcode: 0x%X\n", opcode);
-                    break;
-            }
-            break;
-        case 0x1: // 1nnn: jump to nnn (address)
-            chip->PC = opcode & 0x0FFF;
-            break;
-        case 0x2: // 2nnn: call subroutine at nnn
-            chip->stack[chip->SP] = chip->PC;
-            chip->SP++;
-            chip->PC = opcode & 0x0FFF;
-            break;
-        case 0x3: // skip next instruction if V[x] == kk
-            if (chip->V[(opcode & 0x0F00) >> 8] == (opcode & 0x00FF)) chip->PC += 4;
-            else chip->PC += 2;
-            break;
-        case 0x4: // skip next instruction if V[x] != kk
-            if (chip->V[(opcode & 0x0F00) >> 8] != (opcode & 0x00FF)) chip->PC += 4;
-            else chip->PC += 2;
-            break;
-        case 0x5: // skip next instruction if V[x] == V[y]
-            if (chip->V[(opcode & 0x0F00) >> 8] == chip->V[(opcode & 0x00F0) >> 4]) chip->PC += 4;
-            else chip->PC += 2;
-            break;
-        case 0x6: // set V[x] to kk (byte)
-            chip->V[(opcode & 0x0F00) >> 8] = opcode & 0x00FF;
-            chip->PC += 2;
-            break;
-        case 0x7: // add kk to V[x]
-            chip->V[(opcode & 0x0F00) >> 8] += opcode & 0x00FF;
-            chip->PC += 2;
-            break;
-        case 0x8:
-            switch (opcode & 0x000F) {
-                case 0x0000: // 8xy0: set Vx = Vy
-                    chip->V[(opcode & 0x0F00) >> 8] = chip->V[(opcode & 0x00F0) >> 4];
-                    chip->PC += 2;
-                    break;
-                case 0x0001: // set Vx = Vx OR Vy
-                    chip->V[(opcode & 0x0F00) >> 8] |= chip->V[(opcode & 0x00F0) >> 4];
-                    chip->PC += 2;
-                    break;
-                case 0x0002: // set Vx = Vx AND Vy
-                    chip->V[(opcode & 0x0F00) >> 8] &= chip->V[(opcode & 0x00F0) >> 4];
-                    chip->PC += 2;
-                    break;
-                case 0x0003: // set Vx = Vx XOR Vy
-                    chip->V[(opcode & 0x0F00) >> 8] ^= chip->V[(opcode & 0x00F0) >> 4];
-                    chip->PC += 2;
-                    break;
-                case 0x0004: // set Vx = Vx + Vy, set VF = 1 if addition exceeds 8bits (carry bit)
-                {
-                    int Vx = chip->V[(chip->opcode & 0x0F00) >> 8];
-                    chip->V[(chip->opcode & 0x0F00) >> 8] += chip->V[(chip->opcode & 0x00F0) >> 4];
-                    chip->V[0xF] = chip->V[(opcode & 0x00F0) >> 4] + Vx > 255 ? 1 : 0;
-                }
-                    chip->PC += 2;
-                    break;
-                case 0x0005: // set Vx = Vx - Vy, set VF = 1 if not borrowed
-                {
-                    int Vx = chip->V[(opcode & 0x0F00) >> 8];
-                    chip->V[(opcode & 0x0F00) >> 8] -= chip->V[(opcode & 0x00F0) >> 4];
-                    chip->V[0xF] = Vx > chip->V[(opcode & 0x00F0) >> 4] ? 1 : 0;
-                }
-                    chip->PC += 2;
-                    break;
-                case 0x0006: // set Vx = Vx >> 1, set VF = LSB
-                {
-                    int Vx = chip->V[(opcode & 0x0F00) >> 8];
-                    chip->V[(opcode & 0x0F00) >> 8] >>= 1;
-                    chip->V[0xF] = Vx & 0x1;
-                }
-                    chip->PC += 2;
-                    break;
-                case 0x0007: // set Vx = Vy - Vx, set VF = 1 if not borrowed
-                {
-                    int Vx = chip->V[(opcode & 0x0F00) >> 8];
-                    chip->V[(opcode & 0x0F00) >> 8] = chip->V[(opcode & 0x00F0) >> 4] - chip->V[(opcode & 0x0F00) >> 8];
-                    chip->V[0xF] = chip->V[(opcode & 0x00F0) >> 4] > Vx ? 1 : 0;
-                }
-
-                    chip->PC += 2;
-                    break;
-                case 0x000E: // set Vx = Vx << 1, set VF = MSB
-                {
-                    int Vx = chip->V[(opcode & 0x0F00) >> 8];
-                    chip->V[(opcode & 0x0F00) >> 8] <<= 1;
-                    chip->V[0xF] = (Vx >> 7) & 0x1;
-                }
-                    chip->PC += 2;
-                    break;
-                default:
-                    printf("No such opcode: 0x%X\n", opcode);
-                    break;
-            }
-            break;
-        case 0x9: // skip next instruction if Vx != Vy
-            if (chip->V[(opcode & 0x0F00) >> 8] != chip->V[(opcode & 0x00F0) >> 4]) chip->PC += 4;
-            else chip->PC += 2;
-            break;
-        case 0xA: // Annn: set I to nnn (address)
-            chip->I = opcode & 0x0FFF;
-            chip->PC += 2;
-            break;
-        case 0xB: // jump to nnn + V0
-            chip->PC = (opcode & 0x0FFF) + chip->V[0];
-            chip->PC += 2;
-            break;
-        case 0xC: // set Vx = random byte & kk
-            chip->V[(opcode & 0x0F00) >> 8] = (opcode & 0x00FF) & rand() % 256;
-            chip->PC += 2;
-            break;
-        case 0xD: // display n-byte sprite, starting at I
-        {
-            unsigned short x = chip->V[(opcode & 0x0F00) >> 8];
-            unsigned short y = chip->V[(opcode & 0x00F0) >> 4];
-            unsigned short height = opcode & 0x000F;
-            unsigned short pixel;
-
-            chip->V[0xF] = 0;
-            for (int yline = 0; yline < height; yline++) {
-                pixel = chip->memory[chip->I + yline];
-                for (int xline = 0; xline < 8; xline++) {
-                    // check if current pixel is 1
-                    if ((pixel & (0x80 >> xline)) != 0) {
-                        /*// check if pixel on display is set to 1
-                        if (chip->display[(x + xline + ((y + yline) * 64))] == 1)
-                            chip->V[0xF] = 1; // register collision, set VF to 1
-                        chip->display[x + xline + ((y + yline) * 64)] ^= 1; // XOR pixel*/
-                        int posX = (x + xline) % 64;
-                        int posY = (y + yline) % 32;
-                        int index = posX + posY * 64;
-
-                        if (chip->display[index] == 1) {
-                            // Collision detected
-                            chip->V[0xF] = 1;
-                        }
-                        chip->display[index] ^= 1;
-                    }
-                }
-            }
-
-            chip->draw_flag = true;
-            chip->PC += 2;
-        }
-            break;
-        case 0xE:
-            switch (opcode & 0x00FF) {
-                case 0x009E: // skip next instruction if key with value of Vx is pressed
-                    if (chip->key[chip->V[(opcode & 0x0F00) >> 8]] != 0) {
-                        chip->key_pressed = true;
-                        chip->PC += 4;
-                    } else chip->PC += 2;
-                    break;
-                case 0x00A1: // skip next instruction if key with value of Vx is not pressed
-                    if (chip->key[chip->V[(opcode & 0x0F00) >> 8]] == 0) chip->PC += 4;
-                    else {
-                        chip->key_pressed = true;
-                        chip->PC += 2;
-                    }
-                    chip->key_pressed = true;
-                    break;
-                default:
-                    printf("No such opcode: 0x%X\n", opcode);
-                    break;
-            }
-            break;
-        case 0xF:
-            switch (opcode & 0x00FF) {
-                case 0x0007: // set Vx = delay_register
-                    chip->V[(opcode & 0x0F00) >> 8] = chip->delay_register;
-                    chip->PC += 2;
-                    break;
-                case 0x000A: // wait for key press, store key value in Vx
-                    for (int i = 0; i < 16; i++) {
-                        if (chip->key[i] != 0) {
-                            chip->V[(opcode & 0x0F00) >> 8] = i;
-                            printf("got key\n");
-                            chip->PC += 2;
-                            chip->key_pressed = true;
-                        }
-                    }
-                    break;
-                case 0x0015: // set delay_register = Vx
-                    chip->delay_register = chip->V[(opcode & 0x0F00) >> 8];
-                    chip->PC += 2;
-                    break;
-                case 0x0018: // set sound_register = Vx
-                    chip->sound_register = chip->V[(opcode & 0x0F00) >> 8];
-                    chip->PC += 2;
-                    break;
-                case 0x001E: // set I = I + Vx
-                    chip->I += chip->V[(opcode & 0x0F00) >> 8];
-                    chip->PC += 2;
-                    break;
-                case 0x0029: // TODO to be implemented
-                    chip->I = chip->V[(opcode & 0x0F00) >> 8] * 5;
-                    chip->PC += 2;
-                    break;
-                case 0x0033: // BCD-presentation of Vx at memory[I, I+1, I+2]
-                    chip->memory[chip->I] = chip->V[(opcode & 0x0F00) >> 8] / 100;
-                    chip->memory[chip->I + 1] = (chip->V[(opcode & 0x0F00) >> 8] / 10) % 10;
-                    chip->memory[chip->I + 2] = (chip->V[(opcode & 0x0F00) >> 8] % 100) % 10;
-                    chip->PC += 2;
-                    break;
-                case 0x0055: // store V0...Vx in memory at I
-                    for (int i = 0; i <= (opcode & 0x0F00) >> 8; i++) {
-                        //memcpy(&chip->memory[chip->I + i], &chip->V[i], sizeof(uint8_t));
-                        chip->memory[chip->I] = chip->V[i];
-                        chip->I += 1;
-                    }
-                    chip->PC += 2;
-                    break;
-                case 0x0065: // store memory to V0...Vx starting at I
-                    for (int i = 0; i <= (opcode & 0x0F00) >> 8; i++) {
-                        chip->V[i] = chip->memory[chip->I];
-                        chip->I += 1;
-                    }
-                    chip->PC += 2;
-                    break;
-                default:
-                    printf("No such opcode: 0x%X\n", opcode);
-                    break;
-            }
-            break;
-        default:
-            printf("No such opcode: 0x%X\n", opcode);
-    }
-}
-
-void update_key_states(Chip_8 *chip, SDL_Event event) {
-    SDL_Keycode keyPressed = event.key.keysym.sym;
-
+// maps a host key to the chip-8 keypad, returns -1 if the key isn't mapped
+int map_key(SDL_Keycode keyPressed) {
     switch (keyPressed) {
         case SDLK_UP:
         case SDLK_1: // up
-            chip->key[1] = 1;
-            break;
+            return 1;
         case SDLK_2:
-            chip->key[2] = 1;
-            break;
+            return 2;
         case SDLK_LEFT:
         case SDLK_3: // left
-            chip->key[3] = 1;
-            break;
+            return 3;
         case SDLK_RIGHT:
         case SDLK_4: // right
-            chip->key[12] = 1;
-            break;
+            return 12;
         case SDLK_DOWN:
         case SDLK_q: // down
-            chip->key[4] = 1;
-            break;
+            return 4;
         case SDLK_w:
-            chip->key[5] = 1;
-            break;
+            return 5;
         case SDLK_e:
-            chip->key[6] = 1;
-            break;
+            return 6;
         case SDLK_r:
-            chip->key[13] = 1;
-            break;
+            return 13;
         case SDLK_i: // second player up
         case SDLK_a:
-            chip->key[7] = 1;
-            break;
+            return 7;
         case SDLK_s:
-            chip->key[8] = 1;
-            break;
+            return 8;
         case SDLK_j: // second player left
         case SDLK_d:
-            chip->key[9] = 1;
-            break;
+            return 9;
         case SDLK_l: // second player right
         case SDLK_f:
-            chip->key[14] = 1;
-            break;
+            return 14;
         case SDLK_k: // second player down
         case SDLK_y:
-            chip->key[10] = 1;
-            break;
+            return 10;
         case SDLK_x:
-            chip->key[0] = 1;
-            break;
+            return 0;
         case SDLK_c:
-            chip->key[11] = 1;
-            break;
+            return 11;
         case SDLK_v:
-            chip->key[15] = 1;
-            break;
+            return 15;
         default:
             printf("pressed key not mapped\n");
-            break;
+            return -1;
     }
 }
 
-void emulate(Chip_8 *chip) {
-    // ---fetch opcode---
-    // the opcode is two bytes long, the memory-array contains one byte-addresses each. We concatenate both bytes:
-    chip->opcode = chip->memory[chip->PC] << 8 | chip->memory[chip->PC + 1];
-    // ---decode & execute opcode---
-    decode_and_execute(chip);
+// schedules the emulation in 60 Hz frames (TIMER_HZ) of `cycles_per_frame` instructions each,
+// paced by the high resolution performance counter instead of SDL_GetTicks()
+typedef struct Scheduler {
+    unsigned int cycles_per_frame; // most games use 400-800Hz, default is FRAME_RATE
+    Engine *engine;
+    Synth *synth; // receives the changes of the tone
+    Movie *replay; // input applied at the start of each frame, NULL for live input
+    Capture *capture; // receives every emulated frame, NULL if not recording
+    Uint64 frame_ticks; // performance counter ticks per frame
+    Uint64 next_frame; // performance counter value at which the next frame is due
+    uint64_t cycles; // emulated instructions so far
+    uint64_t frames; // emulated frames so far
+    bool beeping;
+} Scheduler;
+
+void init_scheduler(Scheduler *scheduler, Engine *engine, Synth *synth, unsigned int cycles_per_frame) {
+    scheduler->cycles_per_frame = cycles_per_frame;
+    scheduler->engine = engine;
+    scheduler->synth = synth;
+    scheduler->replay = NULL;
+    scheduler->capture = NULL;
+    scheduler->frame_ticks = SDL_GetPerformanceFrequency() / TIMER_HZ;
+    scheduler->next_frame = SDL_GetPerformanceCounter();
+    scheduler->cycles = 0;
+    scheduler->frames = 0;
+    scheduler->beeping = false;
 }
 
-// delay_timer usually runs on 60 Hz (TIMER_HZ)
-void delay_timer(Chip_8 *chip, unsigned int *lastTimerTick, SDL_AudioDeviceID audio) {
-    unsigned int currentTick = SDL_GetTicks();
-    if (currentTick - *lastTimerTick >= 1000 / TIMER_HZ) {
-        if (chip->delay_register > 0) {
-            chip->delay_register--;
-        }
-        if (chip->sound_register > 0) {
-            SDL_PauseAudioDevice(audio, 0);
-            chip->sound_register--;
-            if (chip->sound_register == 0) SDL_PauseAudioDevice(audio, 1);
-        }
-        *lastTimerTick = currentTick;
+// runs every frame that is due, returns the number of emulated frames
+int run_due_frames(Scheduler *scheduler, Chip_8 *chip) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    int frames = 0;
+    // catch up after short stalls, but never more than MAX_CATCHUP_FRAMES at once
+    while (now >= scheduler->next_frame && frames < MAX_CATCHUP_FRAMES) {
+        if (scheduler->replay) replay_frame(scheduler->replay, chip, (uint32_t) scheduler->frames);
+        scheduler->cycles += run_frame(chip, scheduler->engine, scheduler->cycles_per_frame);
+        scheduler->next_frame += scheduler->frame_ticks;
+        scheduler->frames++;
+        frames++;
+
+        update_tone(scheduler->synth, chip, scheduler->frames, &scheduler->beeping);
+        if (scheduler->capture) capture_frame(scheduler->capture, chip, scheduler->frames);
+        chip->audio_flag = false;
     }
+    // the host stalled for too long (e.g. the window was dragged), skip the missed frames
+    if (now >= scheduler->next_frame) scheduler->next_frame = now + scheduler->frame_ticks;
+    return frames;
 }
 
-// emulation timer runs on higher frequencies (most games use 400-800Hz, I use 400 Hz in FRAME_RATE)
-void emulation_timer(Chip_8 *chip, unsigned int *lastEmulationTick) {
-    unsigned int currentTick = SDL_GetTicks();
-    if (currentTick - *lastEmulationTick >= 1000 / FRAME_RATE) {
-        // Emulate CHIP-8 at a fixed 60Hz rate
-        emulate(chip);
-        *lastEmulationTick = currentTick;
-    }
+// returns true once per due frame without emulating it, used while rewinding
+bool frame_due(Scheduler *scheduler) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now < scheduler->next_frame) return false;
+    scheduler->next_frame += scheduler->frame_ticks;
+    if (now >= scheduler->next_frame) scheduler->next_frame = now + scheduler->frame_ticks;
+    return true;
 }
 
-// creates the sound, found it on stackoverflow :)
-void audioCallback(void *userdata, Uint8 *stream, int len) {
-    // Cast the stream to a 16-bit signed integer pointer
-    Sint16 *audioData = (Sint16 *) stream;
-
-    // Calculate the number of samples in the buffer
-    int numSamples = len / sizeof(Sint16);
-
-    // Generate the audio data for the tone
-    for (int i = 0; i < numSamples; i++) {
-        // Calculate the sine wave value for the current sample
-        double t = (double) i / RATE;
-        double waveValue = AMPLITUDE * sin(2 * M_PI * FREQUENCY * t);
+// sleeps until the next frame is due instead of spinning
+void wait_for_next_frame(Scheduler *scheduler) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now >= scheduler->next_frame) return;
+    Uint64 ms = (scheduler->next_frame - now) * 1000 / SDL_GetPerformanceFrequency();
+    if (ms > 0) SDL_Delay((Uint32) ms);
+}
 
-        // Convert the value to a 16-bit signed integer and store it in the buffer
-        audioData[i] = (Sint16) waveValue;
-    }
+// fills the device buffer from the synth
+void audioCallback(void *userdata, Uint8 *stream, int len) {
+    PROFILE_BEGIN(start);
+    render_audio(userdata, (int16_t *) stream, len / (int) sizeof(int16_t));
+    PROFILE_END(&profile, PROFILE_AUDIO, start);
 }
 
-// initialise SDL_mixer
-SDL_AudioDeviceID init_audio() {
+// initialise audio, the device keeps running and plays silence while the tone is off
+SDL_AudioDeviceID init_audio(Synth *synth) {
     if (SDL_Init(SDL_INIT_AUDIO) < 0) {
         printf("SDL initialization failed: %s\n", SDL_GetError());
-        return 2;
+        return 0;
     }
     SDL_AudioSpec settings, received_settings;
     SDL_zero(settings);
-    settings.freq = RATE;
+    settings.freq = AUDIO_RATE;
     settings.format = AUDIO_S16SYS; // 16-bit signed, little-endian
     settings.channels = 1;          // mono
-    settings.samples = 1024;        // buffer size
+    settings.samples = 512;         // buffer size
     settings.callback = audioCallback;
+    settings.userdata = synth;
 
     // initialise audio
     SDL_AudioDeviceID audio_id = SDL_OpenAudioDevice(NULL, 0, &settings, &received_settings, 0);
+    if (audio_id != 0) SDL_PauseAudioDevice(audio_id, 0);
     return audio_id;
 }
 
+// state shared between the emulation thread and the render thread
+typedef struct Emulation {
+    Chip_8 *chip;
+    Scheduler scheduler;
+    Triple_Buffer frames; // emulation -> render
+    Display published; // the display of the latest published frame
+    bool any_published;
+    Input_Ring input; // render -> emulation
+    atomic_ullong cycle; // emulated cycle of the next frame, used to stamp input events
+    Rewind rewind; // disabled if its allocation failed or a movie is recorded or replayed
+    Movie *record; // receives the live input, NULL if not recording
+    atomic_bool rewinding; // set while the rewind key is held
+    atomic_bool quit;
+} Emulation;
+
+// hands the display to the render thread
+void publish_display(Emulation *emulation, uint64_t input_time) {
+    Dirty_Region dirty = {0};
+    take_dirty(emulation->chip, &dirty);
+    memcpy(&emulation->published, &emulation->chip->display, sizeof(emulation->published));
+    emulation->any_published = true;
+    Frame *frame = back_frame(&emulation->frames);
+    memcpy(&frame->display, &emulation->chip->display, sizeof(frame->display));
+    frame->cycle = emulation->scheduler.cycles;
+    frame->input_time = input_time;
+    publish_frame(&emulation->frames);
+    emulation->chip->draw_flag = false;
+}
+
+// runs the cpu core on its own thread, so slow presents don't slow down emulation
+int emulation_thread(void *data) {
+    Emulation *emulation = data;
+    Chip_8 *chip = emulation->chip;
+    Scheduler *scheduler = &emulation->scheduler;
+    uint64_t input_time = 0;
+    bool reported = false;
+#ifdef CHIP8_PROFILE
+    uint64_t last_dump = profile_now();
+#endif
+
+    while (!atomic_load(&emulation->quit)) {
+        // apply the input that arrived since the last frame, live input is ignored while replaying
+        Input_Event event;
+        while (pop_input(&emulation->input, &event)) {
+            Movie *replay = scheduler->replay;
+            if (replay && replay->next < replay->count) continue;
+            set_key(chip, event.key, event.pressed);
+            if (emulation->record) record_event(emulation->record, (uint32_t) scheduler->frames, event.key, event.pressed);
+            input_time = event.time;
+        }
+
+        bool rewind_enabled = emulation->rewind.arena != NULL;
+        if (rewind_enabled && atomic_load(&emulation->rewinding)) {
+            // step back one recorded frame per emulated frame
+            if (frame_due(scheduler) && step_back(&emulation->rewind, chip))
+                publish_display(emulation, input_time);
+        } else {
+            PROFILE_BEGIN(start);
+            int frames = run_due_frames(scheduler, chip);
+            PROFILE_END(chip->profile, PROFILE_EMULATE, start);
+            // handle emulation and timers
+            if (frames && rewind_enabled) push_rewind(&emulation->rewind, chip);
+            if (frames && chip->draw_flag) {
+                // sprites drawn and erased again within the frame, as some games do to flicker, leave the
+                // display as it was. only the dirty rows are compared
+                if (!emulation->any_published || display_changed(&chip->dirty, &emulation->published, &chip->display))
+                    publish_display(emulation, input_time);
+                else {
+                    Dirty_Region discarded = {0};
+                    take_dirty(chip, &discarded);
+                    chip->draw_flag = false;
+                }
+            }
+        }
+        atomic_store(&emulation->cycle, scheduler->cycles);
+
+        if (chip->halted && !reported) {
+            if (chip->halt_reason == HALT_EXIT) printf("program exited\n");
+            else if (chip->halt_reason == HALT_STACK_OVERFLOW) printf("Stack overflow: 0x%X\n", chip->opcode);
+            else if (chip->halt_reason == HALT_STACK_UNDERFLOW) printf("Return with an empty stack\n");
+            else printf("No such opcode: 0x%X\n", chip->opcode);
+            reported = true;
+        }
+#ifdef CHIP8_PROFILE
+        if (profile_now() - last_dump >= PROFILE_INTERVAL * 1000000000ULL) {
+            dump_profile(chip->profile, stderr);
+            last_dump = profile_now();
+        }
+#endif
+
+        wait_for_next_frame(scheduler);
+    }
+    return 0;
+}
+
+static void usage() {
+    printf("usage: Chip_8 <rom> [cycles-per-frame] [-m chip8|schip|xo] [-q quirks] [-l library] [-r movie] [-p movie] [-x seed] [-o video.y4m] [-w audio.wav] [-T trace]\n");
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 2) return -1; // return if no rom is provided
-    SDL_Window *window = NULL;
-    SDL_Renderer *renderer = NULL;
+    if (argc < 2) {
+        usage();
+        return -1; // return if no rom is provided
+    }
+    // optional second argument: instructions per frame
+    int i = 2;
+    bool cycles_given = argc > 2 && argv[2][0] != '-';
+    unsigned int cycles_per_frame = cycles_given ? strtoul(argv[i++], NULL, 10) : CYCLES_PER_FRAME;
+    if (cycles_per_frame == 0) cycles_per_frame = CYCLES_PER_FRAME;
+    // -m picks the machine, by default it follows the extension of the rom. -q overrides its quirks,
+    // see parse_quirks(). -l looks the rom up in a library (see library.h) and takes its machine, quirks,
+    // instructions per frame and key layout from there, unless they are given.
+    // -r records the input into a movie, -p replays one, -x seeds the random number generator.
+    // -o records the emulated frames to a Y4M video and -w their sound to a WAV file, see capture.h.
+    // -T writes an execution trace when built with CHIP8_TRACE, see trace.h
+    Machine machine = machine_from_path(argv[1]);
+    bool machine_given = false;
+    const char *library_path = NULL;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    const char *video_path = NULL;
+    const char *audio_path = NULL;
+    const char *trace_path = NULL;
+    uint32_t seed = RNG_SEED;
+    const char *quirk_names = NULL;
+    for (; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage();
+            return -1;
+        }
+        if (strcmp(argv[i], "-r") == 0) record_path = argv[++i];
+        else if (strcmp(argv[i], "-p") == 0) replay_path = argv[++i];
+        else if (strcmp(argv[i], "-o") == 0) video_path = argv[++i];
+        else if (strcmp(argv[i], "-w") == 0) audio_path = argv[++i];
+        else if (strcmp(argv[i], "-T") == 0) trace_path = argv[++i];
+        else if (strcmp(argv[i], "-x") == 0) seed = strtoul(argv[++i], NULL, 16);
+        else if (strcmp(argv[i], "-l") == 0) library_path = argv[++i];
+        else if (strcmp(argv[i], "-q") == 0) {
+            uint8_t quirks = 0;
+            quirk_names = argv[++i];
+            if (parse_quirks(quirk_names, &quirks) == -1) {
+                usage();
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-m") == 0) {
+            machine_given = true;
+            i++;
+            if (strcmp(argv[i], "chip8") == 0) machine = MACHINE_CHIP8;
+            else if (strcmp(argv[i], "schip") == 0) machine = MACHINE_SCHIP;
+            else if (strcmp(argv[i], "xo") == 0) machine = MACHINE_XO_CHIP;
+            else {
+                usage();
+                return -1;
+            }
+        } else {
+            usage();
+            return -1;
+        }
+    }
 
-    if (init_graphics(&window, &renderer) == 1) return 1;
-    SDL_AudioDeviceID audio_id = init_audio();
+    // initialise chip-8
+    Chip_8 chip;
+    init_chip(&chip);
+    set_machine(&chip, machine);
+    int rom_size = load_program_to_memory(&chip, argv[1]);
+    if (rom_size == -1) return -3;
+    // chip-8 key sent for each key of the keypad
+    uint8_t key_layout[16];
+    for (int key = 0; key < 16; key++) key_layout[key] = key;
+    if (library_path) {
+        Rom_Library library;
+        Rom_Entry entry;
+        if (open_library(&library, library_path) == -1) {
+            printf("could not open library %s\n", library_path);
+            return -3;
+        }
+        if (find_rom(&library, rom_hash(&chip.memory[512], rom_size), &entry) == 0) {
+            if (machine_given) entry.machine = machine;
+            if (load_rom_entry(&chip, &entry) == -1) return -3;
+            if (!cycles_given) cycles_per_frame = entry.cycles_per_frame;
+            memcpy(key_layout, entry.keys, sizeof(key_layout));
+        } else printf("%s is not in the library\n", argv[1]);
+        close_library(&library);
+    }
+    if (quirk_names) {
+        uint8_t quirks = chip.quirks;
+        parse_quirks(quirk_names, &quirks);
+        set_quirks(&chip, quirks);
+    }
+
+    // a replayed movie brings its own settings
+    static Movie replay, record;
+    if (replay_path) {
+        if (load_movie(&replay, replay_path) == -1) {
+            printf("could not load movie %s\n", replay_path);
+            return -3;
+        }
+        if (replay.program != program_hash(&chip)) printf("movie was recorded with a different rom\n");
+        seed = replay.seed;
+        cycles_per_frame = replay.cycles_per_frame;
+    }
+    seed_random(&chip, seed);
+#ifdef CHIP8_PROFILE
+    init_profile(&profile, cycles_per_frame * TIMER_HZ);
+    chip.profile = &profile;
+#endif
+    init_movie(&record, seed, cycles_per_frame, program_hash(&chip));
+
+    Screen screen;
+    if (init_graphics(&screen) == 1) return 1;
+    static Synth synth;
+    init_synth(&synth);
+    SDL_AudioDeviceID audio_id = init_audio(&synth);
 
     // failed to initialise audio
     if (audio_id == 0) {
@@ -566,54 +473,118 @@ int main(int argc, char *argv[]) {
         return 2;
     }
 
-    // initialise chip-8
-    Chip_8 chip = init_chip();
-    if (load_program_to_memory(&chip, argv[1]) == -1) return -3;
-
     // timer
-    unsigned int lastTimerTick = SDL_GetTicks();
-    unsigned int lastEmulationTick = SDL_GetTicks();
+    static Engine engine;
+    init_engine(&engine, ENGINE_DECODE_CACHE);
+    static Emulation emulation;
+    emulation.chip = &chip;
+    init_scheduler(&emulation.scheduler, &engine, &synth, cycles_per_frame);
+    init_triple_buffer(&emulation.frames);
+    init_input_ring(&emulation.input);
+    atomic_init(&emulation.cycle, 0);
+    atomic_init(&emulation.quit, false);
+    atomic_init(&emulation.rewinding, false);
+    if (replay_path) emulation.scheduler.replay = &replay;
+    if (record_path) emulation.record = &record;
+    // the encoder drops frames rather than holding up the emulation thread
+    if ((video_path || audio_path) && !(emulation.scheduler.capture = open_capture(video_path, audio_path, false)))
+        printf("could not create the capture\n");
+    // records are dropped rather than holding up the emulation thread
+#ifdef CHIP8_TRACE
+    if (trace_path && !(chip.trace = open_trace(trace_path, false))) printf("could not create trace %s\n", trace_path);
+#else
+    if (trace_path) printf("built without CHIP8_TRACE, no trace is written\n");
+#endif
+    // stepping back would make the recorded input diverge from the emulated frames
+    if (replay_path || record_path) printf("rewind is disabled while recording or replaying a movie\n");
+    else if (init_rewind(&emulation.rewind, REWIND_BYTES, REWIND_FRAMES) == -1) printf("rewind is disabled\n");
+
+    SDL_Thread *thread = SDL_CreateThread(emulation_thread, "emulation", &emulation);
+    if (thread == NULL) {
+        printf("Thread could not be created! SDL_Error: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    // input-to-photon latency of presented frames
+    uint64_t last_input_time = 0;
+    double latency_sum = 0, latency_max = 0;
+    int latency_count = 0;
 
     bool quit = false;
-    bool key_released = false;
     SDL_Event e;
     while (!quit) {
         // handle quitting and keystrokes
         while (SDL_PollEvent(&e) != 0) {
             if (e.type == SDL_QUIT) {
                 quit = true;
-            } else if (e.type == SDL_KEYDOWN) {
-                update_key_states(&chip, e);
-            } else if (e.type == SDL_KEYUP) {
-                key_released = true;
+            } else if ((e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) && e.key.keysym.sym == SDLK_BACKSPACE) {
+                // hold backspace to rewind
+                atomic_store(&emulation.rewinding, e.type == SDL_KEYDOWN);
+            } else if ((e.type == SDL_KEYDOWN && !e.key.repeat) || e.type == SDL_KEYUP) {
+                Input_Event event;
+                event.cycle = atomic_load(&emulation.cycle);
+                event.time = SDL_GetPerformanceCounter();
+                event.pressed = e.type == SDL_KEYDOWN;
+                int key = event.pressed ? map_key(e.key.keysym.sym) : -1;
+                event.key = (int8_t) (key >= 0 ? key_layout[key] : -1);
+                push_input(&emulation.input, &event);
             }
         }
 
-        // delay timer decremented
-        delay_timer(&chip, &lastTimerTick, audio_id);
-        // handle emulation
-        emulation_timer(&chip, &lastEmulationTick);
-
-        // draw to screen
-        if (chip.draw_flag) {
-            draw(&renderer, &chip);
-            chip.draw_flag = false;
-        }
-
-        // handle keystrokes
-        if (chip.key_pressed && key_released) {
-            for (int i = 0; i < 16; i++) {
-                chip.key[i] = 0;
+        // draw to screen, presenting waits for the host's vsync
+        const Frame *frame = acquire_frame(&emulation.frames);
+        if (frame) {
+            PROFILE_BEGIN(start);
+            draw(&screen, &frame->display);
+            PROFILE_END(&profile, PROFILE_DRAW, start);
+            if (frame->input_time && frame->input_time != last_input_time) {
+                double latency = (double) (SDL_GetPerformanceCounter() - frame->input_time) * 1000 /
+                                 (double) SDL_GetPerformanceFrequency();
+                latency_sum += latency;
+                if (latency > latency_max) latency_max = latency;
+                latency_count++;
+                last_input_time = frame->input_time;
             }
-            chip.key_pressed = false;
-            key_released = false;
+        } else {
+            SDL_Delay(1);
         }
-
+    }
+    atomic_store(&emulation.quit, true);
+    SDL_WaitThread(thread, NULL);
+    free_rewind(&emulation.rewind);
+    Capture *capture = emulation.scheduler.capture;
+    if (capture) {
+        if (capture_dropped(capture)) printf("capture: %llu frames dropped\n", capture_dropped(capture));
+        if (close_capture(capture) == -1) printf("could not write the capture\n");
+    }
+#ifdef CHIP8_TRACE
+    if (chip.trace) {
+        if (chip.trace->dropped) printf("trace: %llu records dropped\n", (unsigned long long) chip.trace->dropped);
+        if (close_trace(chip.trace) == -1) printf("could not write trace %s\n", trace_path);
+    }
+#endif
+    if (replay_path || record_path) {
+        // the headless runner replays a movie to the same hash
+        printf("movie: frames=%llu hash=%016llx\n", (unsigned long long) emulation.scheduler.frames,
+               (unsigned long long) display_hash(&chip));
+    }
+    if (record_path) {
+        record.frames = emulation.scheduler.frames;
+        if (save_movie(&record, record_path) == -1) printf("could not save movie %s\n", record_path);
+    }
+    free_movie(&record);
+    free_movie(&replay);
+#ifdef CHIP8_PROFILE
+    dump_profile(&profile, stderr);
+#endif
+    if (latency_count) {
+        printf("input latency: avg %.1f ms, max %.1f ms over %d inputs\n", latency_sum / latency_count, latency_max,
+               latency_count);
     }
 
     // clean up everything and close
     SDL_CloseAudioDevice(audio_id);
-    close_graphics(window, renderer);
+    close_graphics(&screen);
 
     return 0;
 }
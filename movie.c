@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "movie.h"
+
+void init_movie(Movie *movie, uint32_t seed, unsigned int cycles_per_frame, uint64_t program) {
+    movie->seed = seed;
+    movie->cycles_per_frame = cycles_per_frame;
+    movie->frames = 0;
+    movie->program = program;
+    movie->events = NULL;
+    movie->count = 0;
+    movie->capacity = 0;
+    movie->next = 0;
+}
+
+void free_movie(Movie *movie) {
+    free(movie->events);
+    movie->events = NULL;
+    movie->count = movie->capacity = movie->next = 0;
+}
+
+int record_event(Movie *movie, uint32_t frame, int key, bool pressed) {
+    if (movie->count == movie->capacity) {
+        size_t capacity = movie->capacity ? movie->capacity * 2 : 256;
+        Movie_Event *events = realloc(movie->events, capacity * sizeof(Movie_Event));
+        if (!events) return -1;
+        movie->events = events;
+        movie->capacity = capacity;
+    }
+    Movie_Event *event = &movie->events[movie->count++];
+    event->frame = frame;
+    event->key = (int8_t) key;
+    event->pressed = pressed;
+    return 0;
+}
+
+void replay_frame(Movie *movie, Chip_8 *chip, uint32_t frame) {
+    while (movie->next < movie->count && movie->events[movie->next].frame <= frame) {
+        const Movie_Event *event = &movie->events[movie->next++];
+        set_key(chip, event->key, event->pressed);
+    }
+}
+
+int save_movie(const Movie *movie, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) return -1;
+    fprintf(file, "chip8-movie %d\n", MOVIE_VERSION);
+    fprintf(file, "seed %08" PRIX32 " cycles-per-frame %u frames %" PRIu64 " program %016" PRIX64 "\n", movie->seed,
+            movie->cycles_per_frame, movie->frames, movie->program);
+    for (size_t i = 0; i < movie->count; i++) {
+        const Movie_Event *event = &movie->events[i];
+        fprintf(file, "%" PRIu32 " %d %d\n", event->frame, event->key, event->pressed);
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+int load_movie(Movie *movie, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+    int version;
+    uint32_t seed;
+    unsigned int cycles_per_frame;
+    uint64_t frames, program;
+    if (fscanf(file, "chip8-movie %d seed %" SCNx32 " cycles-per-frame %u frames %" SCNu64 " program %" SCNx64,
+               &version, &seed, &cycles_per_frame, &frames, &program) != 5 || version != MOVIE_VERSION) {
+        fclose(file);
+        return -1;
+    }
+    init_movie(movie, seed, cycles_per_frame, program);
+    movie->frames = frames;
+
+    uint32_t frame;
+    int key, pressed;
+    while (fscanf(file, "%" SCNu32 " %d %d", &frame, &key, &pressed) == 3) {
+        if (record_event(movie, frame, key, pressed != 0) == -1) {
+            free_movie(movie);
+            fclose(file);
+            return -1;
+        }
+    }
+    fclose(file);
+    return 0;
+}
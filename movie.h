@@ -0,0 +1,48 @@
+#ifndef CHIP_8_MOVIE_H
+#define CHIP_8_MOVIE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "chip8.h"
+
+// input movies: key changes keyed by the emulated frame they were applied at, plus everything else
+// a run depends on (random seed, instructions per frame, program). replaying a movie reproduces the
+// run bit-exactly, also headless at full speed.
+//
+// movies are text files:
+//   chip8-movie 1
+//   seed <hex> cycles-per-frame <n> frames <n> program <hex>
+//   <frame> <key> <1 pressed | 0 released>    one line per event, key is -1 for unmapped keys
+
+#define MOVIE_VERSION 1
+
+typedef struct Movie_Event {
+    uint32_t frame; // applied before this frame runs
+    int8_t key;
+    bool pressed;
+} Movie_Event;
+
+typedef struct Movie {
+    uint32_t seed;
+    unsigned int cycles_per_frame;
+    uint64_t frames; // length of the recording
+    uint64_t program; // program_hash() of the machine the movie was recorded on
+    Movie_Event *events;
+    size_t count;
+    size_t capacity;
+    size_t next; // next event to replay
+} Movie;
+
+void init_movie(Movie *movie, uint32_t seed, unsigned int cycles_per_frame, uint64_t program);
+void free_movie(Movie *movie);
+// appends an event, events have to be recorded in frame order. returns -1 if out of memory
+int record_event(Movie *movie, uint32_t frame, int key, bool pressed);
+// applies every event recorded for `frame`
+void replay_frame(Movie *movie, Chip_8 *chip, uint32_t frame);
+
+int save_movie(const Movie *movie, const char *path);
+// returns -1 if the file can't be read or isn't a movie
+int load_movie(Movie *movie, const char *path);
+
+#endif //CHIP_8_MOVIE_H
@@ -0,0 +1,86 @@
+#include <string.h>
+#include <time.h>
+#include "profile.h"
+#include "chip8.h"
+
+#define HOTSPOTS 16 // addresses listed in a dump
+
+// indexed by Instruction_Class
+static const char *class_names[INSTRUCTION_CLASSES] = {
+        "00E0 CLS", "00EE RET", "00Cn SCD", "00Dn SCU", "00FB SCR", "00FC SCL", "00FD EXIT", "00FE LOW", "00FF HIGH",
+        "1nnn JP", "2nnn CALL", "3xkk SE", "4xkk SNE", "5xy0 SE", "5xy2 SAVE", "5xy3 LOAD", "6xkk LD", "7xkk ADD",
+        "8xy0 LD", "8xy1 OR", "8xy2 AND", "8xy3 XOR", "8xy4 ADD", "8xy5 SUB", "8xy6 SHR", "8xy7 SUBN", "8xyE SHL",
+        "9xy0 SNE", "Annn LD I", "Bnnn JP V0", "Cxkk RND", "Dxyn DRW", "Ex9E SKP", "ExA1 SKNP", "F000 LD I long",
+        "Fn01 PLANE", "F002 AUDIO", "Fx07 LD DT", "Fx0A LD K", "Fx15 LD DT", "Fx18 LD ST", "Fx1E ADD I", "Fx29 LD F",
+        "Fx30 LD HF", "Fx33 LD B", "Fx3A PITCH", "Fx55 LD [I]", "Fx65 LD Vx", "Fx75 LD R", "Fx85 LD Vx R", "unknown"
+};
+
+uint64_t profile_now() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+void init_profile(Profile *profile, unsigned int target_ips) {
+    memset(profile->opcodes, 0, sizeof(profile->opcodes));
+    memset(profile->pc, 0, sizeof(profile->pc));
+    profile->frames = profile->draws = profile->collisions = profile->idle = 0;
+    profile->compactions = profile->pool_resets = 0;
+    for (int i = 0; i < PROFILE_TIMERS; i++) atomic_init(&profile->host_ns[i], 0);
+    profile->start_ns = profile_now();
+    profile->target_ips = target_ips;
+}
+
+void dump_profile(const Profile *profile, FILE *out) {
+    uint64_t classes[INSTRUCTION_CLASSES] = {0};
+    uint64_t instructions = 0;
+    for (uint32_t opcode = 0; opcode <= 0xFFFF; opcode++) {
+        if (!profile->opcodes[opcode]) continue;
+        Instruction in;
+        // named as on XO-CHIP, which knows every instruction
+        decode_instruction((uint16_t) opcode, MACHINE_XO_CHIP, 0, &in);
+        classes[instruction_class(&in)] += profile->opcodes[opcode];
+        instructions += profile->opcodes[opcode];
+    }
+    double seconds = (double) (profile_now() - profile->start_ns) / 1e9;
+    if (seconds <= 0) seconds = 1e-9;
+
+    fprintf(out, "{\"seconds\": %.3f, \"frames\": %llu, \"fps\": %.1f, \"instructions\": %llu, \"ips\": %.0f, "
+                 "\"target_ips\": %u, \"draws\": %llu, \"collisions\": %llu, \"idle\": %llu, ", seconds,
+            (unsigned long long) profile->frames, (double) profile->frames / seconds, (unsigned long long) instructions,
+            (double) instructions / seconds, profile->target_ips, (unsigned long long) profile->draws,
+            (unsigned long long) profile->collisions, (unsigned long long) profile->idle);
+    fprintf(out, "\"block_pool\": {\"compactions\": %llu, \"resets\": %llu}, ",
+            (unsigned long long) profile->compactions, (unsigned long long) profile->pool_resets);
+    fprintf(out, "\"host_ms\": {\"emulate\": %.1f, \"draw\": %.1f, \"audio\": %.1f}, ",
+            (double) atomic_load(&profile->host_ns[PROFILE_EMULATE]) / 1e6,
+            (double) atomic_load(&profile->host_ns[PROFILE_DRAW]) / 1e6,
+            (double) atomic_load(&profile->host_ns[PROFILE_AUDIO]) / 1e6);
+
+    fprintf(out, "\"opcodes\": {");
+    const char *separator = "";
+    for (unsigned int i = 0; i < INSTRUCTION_CLASSES; i++) {
+        if (!classes[i]) continue;
+        fprintf(out, "%s\"%s\": %llu", separator, class_names[i], (unsigned long long) classes[i]);
+        separator = ", ";
+    }
+
+    // the most executed addresses, picked one after another
+    fprintf(out, "}, \"hotspots\": [");
+    uint64_t last = UINT64_MAX;
+    int last_address = -1;
+    for (int n = 0; n < HOTSPOTS; n++) {
+        int best = -1;
+        for (int address = 0; address < 65536; address++) {
+            uint64_t count = profile->pc[address];
+            if (!count || count > last || (count == last && address <= last_address)) continue;
+            if (best == -1 || count > profile->pc[best]) best = address;
+        }
+        if (best == -1) break;
+        fprintf(out, "%s{\"pc\": \"0x%03X\", \"count\": %llu}", n ? ", " : "", best,
+                (unsigned long long) profile->pc[best]);
+        last = profile->pc[best];
+        last_address = best;
+    }
+    fprintf(out, "]}\n");
+}
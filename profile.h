@@ -0,0 +1,64 @@
+#ifndef CHIP_8_PROFILE_H
+#define CHIP_8_PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// profiling of the emulated program and the host, only collected when built with CHIP8_PROFILE.
+// without it the PROFILE_* hooks compile to nothing and Chip_8 has no profile pointer
+
+#define PROFILE_INTERVAL 5 // seconds between the periodic dumps of the frontend
+
+typedef enum Profile_Timer {
+    PROFILE_EMULATE, // running frames on the emulation thread
+    PROFILE_DRAW, // presenting on the render thread
+    PROFILE_AUDIO, // filling buffers in the audio callback
+    PROFILE_TIMERS
+} Profile_Timer;
+
+typedef struct Profile {
+    // owned by the thread running the machine
+    uint64_t opcodes[65536]; // executions per opcode, grouped into instructions when dumped
+    uint64_t pc[65536]; // executions per address
+    uint64_t frames;
+    uint64_t draws;
+    uint64_t collisions; // draws that turned a pixel off
+    uint64_t idle; // instructions skipped while the program waited, see skip_idle()
+    uint64_t compactions; // times the block pool was full and the dropped blocks were reclaimed
+    uint64_t pool_resets; // times the blocks in use still filled the pool and all were dropped
+    // host time in ns, added to from any thread
+    atomic_ullong host_ns[PROFILE_TIMERS];
+    uint64_t start_ns;
+    unsigned int target_ips; // instructions per second the frontend aims for
+} Profile;
+
+uint64_t profile_now();
+void init_profile(Profile *profile, unsigned int target_ips);
+// writes the counters as one JSON object
+void dump_profile(const Profile *profile, FILE *out);
+
+#ifdef CHIP8_PROFILE
+#define PROFILE_STEP(profile, address, opcode) \
+    do { if (profile) { (profile)->opcodes[opcode]++; (profile)->pc[(uint16_t) (address)]++; } } while (0)
+#define PROFILE_DRAW(profile, collided) \
+    do { if (profile) { (profile)->draws++; (profile)->collisions += (collided); } } while (0)
+#define PROFILE_FRAME(profile) do { if (profile) (profile)->frames++; } while (0)
+#define PROFILE_IDLE(profile, cycles) do { if (profile) (profile)->idle += (cycles); } while (0)
+#define PROFILE_COMPACT(profile) do { if (profile) (profile)->compactions++; } while (0)
+#define PROFILE_POOL_RESET(profile) do { if (profile) (profile)->pool_resets++; } while (0)
+#define PROFILE_BEGIN(start) uint64_t start = profile_now()
+// `profile` can't be NULL here
+#define PROFILE_END(profile, timer, start) atomic_fetch_add(&(profile)->host_ns[timer], profile_now() - (start))
+#else
+#define PROFILE_STEP(profile, address, opcode) ((void) 0)
+#define PROFILE_DRAW(profile, collided) ((void) 0)
+#define PROFILE_FRAME(profile) ((void) 0)
+#define PROFILE_IDLE(profile, cycles) ((void) 0)
+#define PROFILE_COMPACT(profile) ((void) 0)
+#define PROFILE_POOL_RESET(profile) ((void) 0)
+#define PROFILE_BEGIN(start) ((void) 0)
+#define PROFILE_END(profile, timer, start) ((void) 0)
+#endif
+
+#endif //CHIP_8_PROFILE_H
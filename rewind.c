@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <string.h>
+#include "rewind.h"
+
+int init_rewind(Rewind *rewind, size_t bytes, unsigned int frames) {
+    rewind->arena = malloc(bytes);
+    rewind->records = malloc(frames * sizeof(Rewind_Record));
+    if (!rewind->arena || !rewind->records) {
+        free_rewind(rewind);
+        return -1;
+    }
+    rewind->arena_size = bytes;
+    rewind->capacity = frames;
+    rewind->first = 0;
+    rewind->count = 0;
+    rewind->has_current = false;
+    return 0;
+}
+
+void free_rewind(Rewind *rewind) {
+    free(rewind->arena);
+    free(rewind->records);
+    rewind->arena = NULL;
+    rewind->records = NULL;
+}
+
+static uint8_t *put_varint(uint8_t *p, size_t v) {
+    while (v >= 0x80) {
+        *p++ = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static const uint8_t *get_varint(const uint8_t *p, size_t *v) {
+    size_t value = 0;
+    int shift = 0;
+    do {
+        value |= (size_t) (*p & 0x7F) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+    *v = value;
+    return p;
+}
+
+// encodes a ^ b as pairs of (zero run, literal run) lengths, each literal run followed by its bytes
+static size_t encode_delta(const uint8_t *a, const uint8_t *b, size_t size, uint8_t *out) {
+    uint8_t *p = out;
+    size_t i = 0;
+    while (i < size) {
+        size_t zeros = i;
+        while (i < size && a[i] == b[i]) i++;
+        zeros = i - zeros;
+        size_t literals = i;
+        // short runs of equal bytes stay inside the literal, a new pair costs at least two bytes
+        while (i < size && (a[i] != b[i] || (i + 2 < size && a[i + 1] != b[i + 1]))) i++;
+        literals = i - literals;
+        p = put_varint(p, zeros);
+        p = put_varint(p, literals);
+        for (size_t j = i - literals; j < i; j++) *p++ = a[j] ^ b[j];
+    }
+    return p - out;
+}
+
+// applies an encoded delta to `state` in place
+static void apply_delta(uint8_t *state, const uint8_t *delta, size_t length) {
+    const uint8_t *p = delta, *end = delta + length;
+    size_t i = 0;
+    while (p < end) {
+        size_t zeros, literals;
+        p = get_varint(p, &zeros);
+        p = get_varint(p, &literals);
+        i += zeros;
+        for (size_t j = 0; j < literals; j++) state[i++] ^= *p++;
+    }
+}
+
+static void drop_oldest(Rewind *rewind) {
+    rewind->first = (rewind->first + 1) % rewind->capacity;
+    rewind->count--;
+}
+
+// finds room for `length` bytes after the newest record, dropping the oldest ones it would overwrite
+static uint32_t allocate_record(Rewind *rewind, size_t length) {
+    uint32_t offset = 0;
+    if (rewind->count) {
+        const Rewind_Record *last = &rewind->records[(rewind->first + rewind->count - 1) % rewind->capacity];
+        offset = last->offset + last->length;
+        if (offset + length > rewind->arena_size) {
+            // wrap around, the records left in the tail of the arena are the oldest ones
+            while (rewind->count && rewind->records[rewind->first].offset >= offset) drop_oldest(rewind);
+            offset = 0;
+        }
+    }
+    while (rewind->count) {
+        const Rewind_Record *oldest = &rewind->records[rewind->first];
+        bool overlaps = oldest->offset < offset + length && offset < oldest->offset + oldest->length;
+        if (!overlaps && rewind->count < rewind->capacity) break;
+        drop_oldest(rewind);
+    }
+    return offset;
+}
+
+void push_rewind(Rewind *rewind, const Chip_8 *chip) {
+    if (!rewind->has_current) {
+        save_state(chip, rewind->current, sizeof(rewind->current));
+        rewind->has_current = true;
+        return;
+    }
+    save_state(chip, rewind->scratch, sizeof(rewind->scratch));
+    size_t length = encode_delta(rewind->current, rewind->scratch, SNAPSHOT_SIZE, rewind->encoded);
+    if (length > rewind->arena_size) return;
+
+    uint32_t offset = allocate_record(rewind, length);
+    memcpy(rewind->arena + offset, rewind->encoded, length);
+    Rewind_Record *record = &rewind->records[(rewind->first + rewind->count) % rewind->capacity];
+    record->offset = offset;
+    record->length = (uint32_t) length;
+    rewind->count++;
+    memcpy(rewind->current, rewind->scratch, SNAPSHOT_SIZE);
+}
+
+bool step_back(Rewind *rewind, Chip_8 *chip) {
+    if (!rewind->count) return false;
+    unsigned int last = (rewind->first + rewind->count - 1) % rewind->capacity;
+    apply_delta(rewind->current, rewind->arena + rewind->records[last].offset, rewind->records[last].length);
+    rewind->count--;
+    load_state(chip, rewind->current, SNAPSHOT_SIZE);
+    return true;
+}
+
+size_t rewind_usage(const Rewind *rewind) {
+    size_t bytes = 0;
+    for (unsigned int i = 0; i < rewind->count; i++) {
+        bytes += rewind->records[(rewind->first + i) % rewind->capacity].length;
+    }
+    return bytes;
+}
@@ -0,0 +1,46 @@
+#ifndef CHIP_8_REWIND_H
+#define CHIP_8_REWIND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "chip8.h"
+#include "snapshot.h"
+
+// rewind history, one state per frame. only the latest state is kept whole, every older one is stored
+// as the XOR of two neighbouring snapshots with its runs of zeros compressed. XOR works in both
+// directions, so stepping back undoes one delta at a time. when the ring is full the oldest frames
+// are dropped
+
+#define REWIND_FRAMES (10 * 60 * TIMER_HZ) // 10 minutes at one state per frame
+#define REWIND_BYTES (4 * 1024 * 1024)
+
+typedef struct Rewind_Record {
+    uint32_t offset; // position in the arena
+    uint32_t length;
+} Rewind_Record;
+
+typedef struct Rewind {
+    uint8_t *arena; // encoded deltas, allocated once
+    size_t arena_size;
+    Rewind_Record *records; // ring of deltas, oldest first
+    unsigned int capacity;
+    unsigned int first; // index of the oldest record
+    unsigned int count;
+    bool has_current;
+    uint8_t current[SNAPSHOT_SIZE]; // latest state
+    uint8_t scratch[SNAPSHOT_SIZE];
+    uint8_t encoded[SNAPSHOT_SIZE * 2]; // worst case encoding of one delta
+} Rewind;
+
+// allocates the history, returns -1 if the allocation failed
+int init_rewind(Rewind *rewind, size_t bytes, unsigned int frames);
+void free_rewind(Rewind *rewind);
+// records the state of the current frame
+void push_rewind(Rewind *rewind, const Chip_8 *chip);
+// restores the state one frame before the latest, returns false if the history is empty
+bool step_back(Rewind *rewind, Chip_8 *chip);
+// bytes used by the encoded history
+size_t rewind_usage(const Rewind *rewind);
+
+#endif //CHIP_8_REWIND_H
@@ -0,0 +1,18 @@
+# runs golden_mismatch.txt, whose frame can't match, and checks that the run fails and writes the
+# actual frame and the diff as PBM images. run by ctest with -DHEADLESS=<Chip_8_headless> -DWORK_DIR=<dir>
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+execute_process(COMMAND ${HEADLESS} -V ${CMAKE_CURRENT_LIST_DIR}/golden_mismatch.txt -e cache
+                WORKING_DIRECTORY ${WORK_DIR} RESULT_VARIABLE result OUTPUT_VARIABLE output)
+if (NOT result EQUAL 1)
+    message(FATAL_ERROR "expected the mismatch to exit with 1, got ${result}:\n${output}")
+endif ()
+foreach (image 2-ibm-logo.ch8.cache.pbm 2-ibm-logo.ch8.cache.diff.pbm)
+    if (NOT EXISTS ${WORK_DIR}/${image})
+        message(FATAL_ERROR "${image} was not written:\n${output}")
+    endif ()
+    file(STRINGS ${WORK_DIR}/${image} header LIMIT_COUNT 2)
+    if (NOT header STREQUAL "P1;64 32")
+        message(FATAL_ERROR "${image} is not a 64x32 PBM: ${header}")
+    endif ()
+endforeach ()
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <string.h>
+#include "snapshot.h"
+
+// fields are stored little-endian
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v) {
+    p = put_u16(p, v & 0xFFFF);
+    return put_u16(p, v >> 16);
+}
+
+static uint8_t *put_u64(uint8_t *p, uint64_t v) {
+    p = put_u32(p, v & 0xFFFFFFFF);
+    return put_u32(p, v >> 32);
+}
+
+static const uint8_t *get_u16(const uint8_t *p, uint16_t *v) {
+    *v = p[0] | p[1] << 8;
+    return p + 2;
+}
+
+static const uint8_t *get_u32(const uint8_t *p, uint32_t *v) {
+    uint16_t lo, hi;
+    p = get_u16(p, &lo);
+    p = get_u16(p, &hi);
+    *v = lo | (uint32_t) hi << 16;
+    return p;
+}
+
+static const uint8_t *get_u64(const uint8_t *p, uint64_t *v) {
+    uint32_t lo, hi;
+    p = get_u32(p, &lo);
+    p = get_u32(p, &hi);
+    *v = lo | (uint64_t) hi << 32;
+    return p;
+}
+
+size_t save_state(const Chip_8 *chip, uint8_t *buffer, size_t size) {
+    if (size < SNAPSHOT_SIZE) return 0;
+    uint8_t *p = buffer;
+    memcpy(p, SNAPSHOT_MAGIC, 4);
+    p = put_u16(p + 4, SNAPSHOT_VERSION);
+    p = put_u32(p, SNAPSHOT_SIZE - SNAPSHOT_HEADER_SIZE);
+
+    memcpy(p, chip->memory, sizeof(chip->memory));
+    p += sizeof(chip->memory);
+    p = put_u16(p, chip->opcode);
+    memcpy(p, chip->V, sizeof(chip->V));
+    p += sizeof(chip->V);
+    p = put_u16(p, chip->I);
+    p = put_u16(p, chip->PC);
+    *p++ = chip->SP;
+    *p++ = chip->delay_register;
+    *p++ = chip->sound_register;
+    for (int i = 0; i < STACK_SIZE; i++) p = put_u16(p, chip->stack[i]);
+    memcpy(p, chip->key, sizeof(chip->key));
+    p += sizeof(chip->key);
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        for (int y = 0; y < HIRES_HEIGHT; y++) {
+            for (int word = 0; word < ROW_WORDS; word++) p = put_u64(p, chip->display.planes[plane][y][word]);
+        }
+    }
+    *p++ = chip->display.hires;
+    *p++ = chip->draw_flag;
+    *p++ = chip->key_pressed;
+    *p++ = chip->key_released;
+    *p++ = chip->halted | chip->halt_reason << 1;
+    *p++ = chip->quirks;
+    p = put_u32(p, chip->rng);
+    *p++ = chip->machine;
+    *p++ = chip->plane_mask;
+    memcpy(p, chip->flags, sizeof(chip->flags));
+    p += sizeof(chip->flags);
+    memcpy(p, chip->pattern, sizeof(chip->pattern));
+    p += sizeof(chip->pattern);
+    *p++ = chip->pitch;
+    *p++ = chip->audio_flag;
+    *p++ = chip->vblank;
+    return p - buffer;
+}
+
+// reads the fields in the order save_state() writes them
+static void read_state(Chip_8 *chip, const uint8_t *p) {
+    memcpy(chip->memory, p, sizeof(chip->memory));
+    p += sizeof(chip->memory);
+    p = get_u16(p, &chip->opcode);
+    memcpy(chip->V, p, sizeof(chip->V));
+    p += sizeof(chip->V);
+    p = get_u16(p, &chip->I);
+    p = get_u16(p, &chip->PC);
+    chip->SP = *p++;
+    chip->delay_register = *p++;
+    chip->sound_register = *p++;
+    for (int i = 0; i < STACK_SIZE; i++) p = get_u16(p, &chip->stack[i]);
+    memcpy(chip->key, p, sizeof(chip->key));
+    p += sizeof(chip->key);
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++) {
+        for (int y = 0; y < HIRES_HEIGHT; y++) {
+            for (int word = 0; word < ROW_WORDS; word++) p = get_u64(p, &chip->display.planes[plane][y][word]);
+        }
+    }
+    chip->display.hires = *p++;
+    chip->draw_flag = *p++;
+    chip->key_pressed = *p++;
+    chip->key_released = *p++;
+    chip->halted = *p & 1;
+    chip->halt_reason = (Halt_Reason) (*p++ >> 1);
+    chip->quirks = *p++;
+    p = get_u32(p, &chip->rng);
+    chip->machine = (Machine) *p++;
+    chip->plane_mask = *p++;
+    memcpy(chip->flags, p, sizeof(chip->flags));
+    p += sizeof(chip->flags);
+    memcpy(chip->pattern, p, sizeof(chip->pattern));
+    p += sizeof(chip->pattern);
+    chip->pitch = *p++;
+    chip->audio_flag = *p++;
+    chip->vblank = *p++;
+}
+
+int load_state(Chip_8 *chip, const uint8_t *buffer, size_t size) {
+    uint16_t version;
+    uint32_t length;
+    if (size < SNAPSHOT_HEADER_SIZE || memcmp(buffer, SNAPSHOT_MAGIC, 4) != 0) return -1;
+    const uint8_t *p = get_u16(buffer + 4, &version);
+    p = get_u32(p, &length);
+    if (version != SNAPSHOT_VERSION || length != SNAPSHOT_SIZE - SNAPSHOT_HEADER_SIZE || size < SNAPSHOT_SIZE)
+        return -1;
+
+    // restored into a copy first, the machine is left as it was if the snapshot is rejected
+    Chip_8 state;
+    memcpy(&state, chip, sizeof(state));
+    read_state(&state, p);
+    // a stack pointer past the stack would make 2nnn and 00EE write and read outside of it
+    if (state.SP > STACK_SIZE || state.machine > MACHINE_XO_CHIP || state.halt_reason > HALT_STACK_UNDERFLOW)
+        return -1;
+    memcpy(chip, &state, sizeof(state));
+
+    if (chip->rng == 0) chip->rng = RNG_SEED;
+    chip->address_mask = address_mask(chip->machine);
+    chip->idle = 0;
+
+    // the whole memory changed, drop everything that was decoded from it
+    chip->code_dirty |= CODE_STALE;
+    chip->draw_flag = true;
+    mark_display_dirty(chip);
+    chip->audio_flag = true;
+    return 0;
+}
+
+int save_state_file(const Chip_8 *chip, const char *path) {
+    uint8_t buffer[SNAPSHOT_SIZE];
+    size_t size = save_state(chip, buffer, sizeof(buffer));
+    FILE *file = fopen(path, "wb");
+    if (!file) return -1;
+    size_t written = fwrite(buffer, 1, size, file);
+    fclose(file);
+    return written == size ? 0 : -1;
+}
+
+int load_state_file(Chip_8 *chip, const char *path) {
+    uint8_t buffer[SNAPSHOT_SIZE];
+    FILE *file = fopen(path, "rb");
+    if (!file) return -1;
+    size_t read = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+    return load_state(chip, buffer, read);
+}
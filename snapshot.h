@@ -0,0 +1,30 @@
+#ifndef CHIP_8_SNAPSHOT_H
+#define CHIP_8_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "chip8.h"
+
+// versioned binary snapshot of the complete machine state. every field is written in a fixed order
+// and byte order, so snapshots can be exchanged between builds and hosts.
+// decode and block caches aren't part of the snapshot, they are invalidated on restore
+
+#define SNAPSHOT_MAGIC "C8SS"
+#define SNAPSHOT_VERSION 4
+// header (magic, 16-bit version, 32-bit size) followed by the machine state
+#define SNAPSHOT_HEADER_SIZE 10
+#define SNAPSHOT_SIZE (SNAPSHOT_HEADER_SIZE + MEMORY_SIZE + 2 + 16 + 2 + 2 + 1 + 1 + 1 + STACK_SIZE * 2 + 16 + \
+                       DISPLAY_PLANES * HIRES_HEIGHT * ROW_WORDS * 8 + 1 + 1 + 1 + 1 + 1 + 1 + 4 + \
+                       1 + 1 + 16 + 16 + 1 + 1 + 1)
+
+// writes the snapshot into `buffer` without allocating, returns the number of bytes written
+// or 0 if `size` is smaller than SNAPSHOT_SIZE
+size_t save_state(const Chip_8 *chip, uint8_t *buffer, size_t size);
+// restores a snapshot, returns -1 if it is truncated, has the wrong magic or version or holds a stack
+// pointer or machine that can't exist. the machine is left untouched then
+int load_state(Chip_8 *chip, const uint8_t *buffer, size_t size);
+
+int save_state_file(const Chip_8 *chip, const char *path);
+int load_state_file(Chip_8 *chip, const char *path);
+
+#endif //CHIP_8_SNAPSHOT_H
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <string.h>
+#include "snapshot.h"
+
+// checks that load_state() restores a saved machine and rejects a corrupted stack pointer without
+// touching the machine, and that every engine halts on a call with a full stack and a return with an
+// empty one. run by ctest
+
+static uint8_t buffer[SNAPSHOT_SIZE];
+static uint8_t corrupted[SNAPSHOT_SIZE];
+static Chip_8 chip, restored, before;
+static Engine engine;
+
+static const Engine_Type engines[] = {ENGINE_INTERPRETER, ENGINE_DECODE_CACHE, ENGINE_BLOCKS};
+static const char *engine_names[] = {"interpreter", "cache", "blocks"};
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (ok) return;
+    printf("FAILED: %s\n", what);
+    failures++;
+}
+
+static void check_halt(const Chip_8 *machine, Halt_Reason reason, uint8_t sp, uint16_t pc, const char *what,
+                       const char *engine_name) {
+    if (machine->halted && machine->halt_reason == reason && machine->SP == sp && machine->PC == pc) return;
+    printf("FAILED: %s on %s, halted=%d reason=%d SP=%d PC=%03X\n", what, engine_name, machine->halted,
+           machine->halt_reason, machine->SP, machine->PC);
+    failures++;
+}
+
+// runs a program that recurses forever and one that returns without a call
+static void check_stack_faults(int e) {
+    static const uint8_t recurse[] = {0x22, 0x00};
+    static const uint8_t ret[] = {0x00, 0xEE};
+    Chip_8 *machine = &restored;
+
+    init_chip(machine);
+    load_program(machine, recurse, sizeof(recurse));
+    init_engine(&engine, engines[e]);
+    run_engine(machine, &engine, 100);
+    check_halt(machine, HALT_STACK_OVERFLOW, STACK_SIZE, 0x200, "2200 halts with a full stack", engine_names[e]);
+    for (int i = 0; i < STACK_SIZE; i++) check(machine->stack[i] == 0x200, "2200 fills the stack with its address");
+
+    init_chip(machine);
+    load_program(machine, ret, sizeof(ret));
+    init_engine(&engine, engines[e]);
+    run_engine(machine, &engine, 100);
+    check_halt(machine, HALT_STACK_UNDERFLOW, 0, 0x200, "00EE halts with an empty stack", engine_names[e]);
+}
+
+// the offset of the stack pointer, found as the only byte that changes with it
+static long sp_offset() {
+    static uint8_t other[SNAPSHOT_SIZE];
+    chip.SP = 1;
+    save_state(&chip, buffer, sizeof(buffer));
+    chip.SP = 2;
+    save_state(&chip, other, sizeof(other));
+    long offset = -1;
+    for (long i = 0; i < SNAPSHOT_SIZE; i++) {
+        if (buffer[i] == other[i]) continue;
+        if (offset != -1) return -1;
+        offset = i;
+    }
+    return offset;
+}
+
+int main() {
+    // 2204 calls a subroutine that loops on itself, leaving one return address on the stack
+    static const uint8_t program[] = {0x22, 0x04, 0x00, 0x00, 0x12, 0x04};
+    init_chip(&chip);
+    set_machine(&chip, MACHINE_XO_CHIP);
+    load_program(&chip, program, sizeof(program));
+    init_engine(&engine, ENGINE_INTERPRETER);
+    run_frame(&chip, &engine, 10);
+
+    long offset = sp_offset();
+    check(offset != -1, "the stack pointer is stored in one byte");
+    if (offset == -1) return 1;
+
+    // saved on the call, so stepping the restored machine calls again
+    chip.SP = 1;
+    chip.PC = 0x200;
+    check(save_state(&chip, buffer, sizeof(buffer)) == SNAPSHOT_SIZE, "save_state writes the whole snapshot");
+    init_chip(&restored);
+    check(load_state(&restored, buffer, sizeof(buffer)) == 0, "a saved snapshot loads");
+    check(restored.SP == 1 && restored.stack[0] == chip.stack[0] && restored.PC == chip.PC,
+          "the stack and PC are restored");
+    check(restored.machine == MACHINE_XO_CHIP, "the machine is restored");
+
+    // a full stack is a valid state
+    memcpy(corrupted, buffer, sizeof(buffer));
+    corrupted[offset] = STACK_SIZE;
+    check(load_state(&restored, corrupted, sizeof(corrupted)) == 0 && restored.SP == STACK_SIZE,
+          "a full stack loads");
+    // but can't take another call
+    for (int e = 0; e < 3; e++) {
+        load_state(&restored, corrupted, sizeof(corrupted));
+        memcpy(&before, &restored, sizeof(restored));
+        init_engine(&engine, engines[e]);
+        run_engine(&restored, &engine, 1);
+        check_halt(&restored, HALT_STACK_OVERFLOW, STACK_SIZE, 0x200, "2nnn on a restored full stack",
+                   engine_names[e]);
+        check(memcmp(restored.stack, before.stack, sizeof(before.stack)) == 0, "a call on a full stack keeps it");
+    }
+
+    for (int sp = STACK_SIZE + 1; sp <= 0xFF; sp++) {
+        init_chip(&restored);
+        memcpy(&before, &restored, sizeof(restored));
+        corrupted[offset] = (uint8_t) sp;
+        if (load_state(&restored, corrupted, sizeof(corrupted)) != -1) {
+            printf("FAILED: SP=%d loads\n", sp);
+            failures++;
+            break;
+        }
+        if (memcmp(&before, &restored, sizeof(restored)) != 0) {
+            printf("FAILED: SP=%d changed the machine\n", sp);
+            failures++;
+            break;
+        }
+    }
+
+    for (int e = 0; e < 3; e++) check_stack_faults(e);
+
+    printf("%s\n", failures ? "snapshot: failed" : "snapshot: ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,49 @@
+#include <string.h>
+#include "sync.h"
+
+void init_triple_buffer(Triple_Buffer *buffer) {
+    memset(buffer->frames, 0, sizeof(buffer->frames));
+    buffer->back = 0;
+    atomic_init(&buffer->middle, 1);
+    buffer->front = 2;
+}
+
+Frame *back_frame(Triple_Buffer *buffer) {
+    return &buffer->frames[buffer->back];
+}
+
+void publish_frame(Triple_Buffer *buffer) {
+    // release: the frame contents are visible before the consumer can swap them in
+    unsigned int old = atomic_exchange_explicit(&buffer->middle, buffer->back | FRAME_FRESH, memory_order_acq_rel);
+    buffer->back = old & ~FRAME_FRESH;
+}
+
+const Frame *acquire_frame(Triple_Buffer *buffer) {
+    if (!(atomic_load_explicit(&buffer->middle, memory_order_relaxed) & FRAME_FRESH)) return NULL;
+    unsigned int old = atomic_exchange_explicit(&buffer->middle, buffer->front, memory_order_acq_rel);
+    buffer->front = old & ~FRAME_FRESH;
+    return &buffer->frames[buffer->front];
+}
+
+void init_input_ring(Input_Ring *ring) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+}
+
+bool push_input(Input_Ring *ring, const Input_Event *event) {
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail == INPUT_RING_SIZE) return false;
+    ring->events[head & (INPUT_RING_SIZE - 1)] = *event;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool pop_input(Input_Ring *ring, Input_Event *event) {
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (head == tail) return false;
+    *event = ring->events[tail & (INPUT_RING_SIZE - 1)];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef CHIP_8_SYNC_H
+#define CHIP_8_SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "chip8.h"
+
+// lock-free structures for passing frames and input between the emulation thread and the render thread.
+// each has exactly one producer and one consumer
+
+// a completed frame as published by the emulation thread
+typedef struct Frame {
+    Display display;
+    uint64_t cycle; // emulated cycle the frame was completed at
+    uint64_t input_time; // host time of the latest input applied before this frame, 0 if none
+} Frame;
+
+// triple buffer: the writer always has a buffer to fill and the reader always gets the latest
+// complete frame, neither of them ever waits for the other
+typedef struct Triple_Buffer {
+    Frame frames[3];
+    atomic_uint middle; // index of the buffer in between, FRAME_FRESH set if it wasn't read yet
+    unsigned int back; // written by the producer
+    unsigned int front; // read by the consumer
+} Triple_Buffer;
+
+#define FRAME_FRESH 4u
+
+void init_triple_buffer(Triple_Buffer *buffer);
+// the buffer the producer fills next
+Frame *back_frame(Triple_Buffer *buffer);
+// hands the back buffer to the consumer
+void publish_frame(Triple_Buffer *buffer);
+// returns the newest published frame, or NULL if nothing was published since the last call
+const Frame *acquire_frame(Triple_Buffer *buffer);
+
+typedef struct Input_Event {
+    uint64_t cycle; // emulated cycle the event lands on
+    uint64_t time; // host time the event was received
+    int8_t key; // chip-8 key, -1 if unmapped
+    bool pressed;
+} Input_Event;
+
+#define INPUT_RING_SIZE 64 // power of two
+
+// single producer, single consumer ring of input events
+typedef struct Input_Ring {
+    Input_Event events[INPUT_RING_SIZE];
+    atomic_uint head; // next slot to write, only advanced by the producer
+    atomic_uint tail; // next slot to read, only advanced by the consumer
+} Input_Ring;
+
+void init_input_ring(Input_Ring *ring);
+// returns false if the ring is full
+bool push_input(Input_Ring *ring, const Input_Event *event);
+// returns false if the ring is empty
+bool pop_input(Input_Ring *ring, Input_Event *event);
+
+#endif //CHIP_8_SYNC_H
@@ -0,0 +1,157 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 199309L // nanosleep
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "trace.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define WRITE_CHUNK 4096 // records encoded and written at once
+
+struct Trace_Writer {
+    FILE *file;
+    pthread_t thread;
+    atomic_bool quit;
+    bool failed;
+    uint8_t buffer[WRITE_CHUNK * TRACE_RECORD_SIZE];
+};
+
+static void sleep_briefly() {
+#ifdef _WIN32
+    Sleep(1);
+#else
+    struct timespec delay = {0, 1000000};
+    nanosleep(&delay, NULL);
+#endif
+}
+
+static void put_le(uint8_t *p, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) p[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static uint64_t get_le(const uint8_t *p, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) value |= (uint64_t) p[i] << (8 * i);
+    return value;
+}
+
+static int write_header(FILE *file, uint64_t dropped) {
+    uint8_t header[TRACE_HEADER_SIZE];
+    memcpy(header, TRACE_MAGIC, 4);
+    put_le(header + 4, TRACE_VERSION, 2);
+    put_le(header + 6, TRACE_RECORD_SIZE, 2);
+    put_le(header + 8, dropped, 8);
+    return fwrite(header, sizeof(header), 1, file) == 1 ? 0 : -1;
+}
+
+// writes the records from `tail` up to `head`, returns the new tail
+static unsigned int write_records(Trace *trace, unsigned int tail, unsigned int head) {
+    Trace_Writer *writer = trace->writer;
+    while (tail != head) {
+        unsigned int count = head - tail < WRITE_CHUNK ? head - tail : WRITE_CHUNK;
+        for (unsigned int i = 0; i < count; i++) {
+            const Trace_Record *record = &trace->records[(tail + i) & (TRACE_RING_SIZE - 1)];
+            uint8_t *p = &writer->buffer[i * TRACE_RECORD_SIZE];
+            put_le(p, record->cycle, 8);
+            put_le(p + 8, record->pc, 2);
+            put_le(p + 10, record->opcode, 2);
+            put_le(p + 12, record->I, 2);
+            p[14] = record->x;
+            p[15] = record->vx;
+        }
+        if (fwrite(writer->buffer, TRACE_RECORD_SIZE, count, writer->file) != count) writer->failed = true;
+        tail += count;
+        // hand the slots back as soon as they are encoded
+        atomic_store_explicit(&trace->tail, tail, memory_order_release);
+    }
+    return tail;
+}
+
+static void *writer_thread(void *data) {
+    Trace *trace = data;
+    unsigned int tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+    for (;;) {
+        // read quit first, records appended before it was set are still written
+        bool quit = atomic_load(&trace->writer->quit);
+        unsigned int head = atomic_load_explicit(&trace->head, memory_order_acquire);
+        if (head != tail) tail = write_records(trace, tail, head);
+        else if (quit) break;
+        else sleep_briefly();
+    }
+    return NULL;
+}
+
+Trace *open_trace(const char *path, bool wait) {
+    Trace *trace = calloc(1, sizeof(Trace));
+    if (!trace) return NULL;
+    trace->records = malloc(TRACE_RING_SIZE * sizeof(Trace_Record));
+    trace->writer = calloc(1, sizeof(Trace_Writer));
+    if (!trace->records || !trace->writer) goto fail;
+    trace->wait = wait;
+    atomic_init(&trace->head, 0);
+    atomic_init(&trace->tail, 0);
+    atomic_init(&trace->writer->quit, false);
+
+    trace->writer->file = fopen(path, "wb");
+    if (!trace->writer->file || write_header(trace->writer->file, 0) == -1) goto fail;
+    if (pthread_create(&trace->writer->thread, NULL, writer_thread, trace) != 0) goto fail;
+    return trace;
+
+fail:
+    if (trace->writer && trace->writer->file) fclose(trace->writer->file);
+    free(trace->writer);
+    free(trace->records);
+    free(trace);
+    return NULL;
+}
+
+int close_trace(Trace *trace) {
+    Trace_Writer *writer = trace->writer;
+    atomic_store(&writer->quit, true);
+    pthread_join(writer->thread, NULL);
+    // the number of dropped records is only known now
+    if (fseek(writer->file, 0, SEEK_SET) != 0 || write_header(writer->file, trace->dropped) == -1)
+        writer->failed = true;
+    if (fclose(writer->file) != 0) writer->failed = true;
+    int result = writer->failed ? -1 : 0;
+    free(writer);
+    free(trace->records);
+    free(trace);
+    return result;
+}
+
+bool wait_for_trace(Trace *trace) {
+    if (!trace->wait) return false;
+    unsigned int head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+    while (head - trace->tail_seen == TRACE_RING_SIZE) {
+        sleep_briefly();
+        trace->tail_seen = atomic_load_explicit(&trace->tail, memory_order_acquire);
+    }
+    return true;
+}
+
+int read_trace_header(FILE *file, uint64_t *dropped) {
+    uint8_t header[TRACE_HEADER_SIZE];
+    if (fread(header, sizeof(header), 1, file) != 1 || memcmp(header, TRACE_MAGIC, 4) != 0) return -1;
+    if (get_le(header + 4, 2) != TRACE_VERSION || get_le(header + 6, 2) != TRACE_RECORD_SIZE) return -1;
+    *dropped = get_le(header + 8, 8);
+    return 0;
+}
+
+bool read_trace_record(FILE *file, Trace_Record *record) {
+    uint8_t p[TRACE_RECORD_SIZE];
+    if (fread(p, sizeof(p), 1, file) != 1) return false;
+    record->cycle = get_le(p, 8);
+    record->pc = (uint16_t) get_le(p + 8, 2);
+    record->opcode = (uint16_t) get_le(p + 10, 2);
+    record->I = (uint16_t) get_le(p + 12, 2);
+    record->x = p[14];
+    record->vx = p[15];
+    return true;
+}
@@ -0,0 +1,93 @@
+#ifndef CHIP_8_TRACE_H
+#define CHIP_8_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "chip8.h"
+
+// execution trace, only collected when built with CHIP8_TRACE. the engines append a record per executed
+// instruction to an in-memory ring, a writer thread empties the ring into a file in bulk.
+// chip8_trace disassembles, filters and diffs the files.
+//
+// all fields are little-endian:
+//   header   magic "C8TR", 16-bit version, 16-bit record size, 64-bit number of dropped records
+//   records  64-bit cycle, 16-bit PC, 16-bit opcode, 16-bit I, x operand, Vx
+
+#define TRACE_MAGIC "C8TR"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 16
+#define TRACE_RECORD_SIZE 16
+#define TRACE_RING_SIZE (1 << 20) // records, power of two
+
+typedef struct Trace_Record {
+    uint64_t cycle; // instructions executed before this one, including skipped idle loops
+    uint16_t pc;
+    uint16_t opcode;
+    // registers after executing, for most instructions Vx is the one that changed
+    uint16_t I;
+    uint8_t x;
+    uint8_t vx;
+} Trace_Record;
+
+typedef struct Trace_Writer Trace_Writer;
+
+struct Trace {
+    Trace_Record *records; // TRACE_RING_SIZE of them
+    atomic_uint head; // next record to fill, only advanced by the emulation thread
+    atomic_uint tail; // next record to write, only advanced by the writer
+    unsigned int tail_seen; // last tail read by the emulation thread
+    uint64_t cycle;
+    uint64_t dropped; // records lost while the ring was full
+    bool wait;
+    Trace_Writer *writer;
+};
+
+// starts the writer thread. with `wait` the emulation waits for the writer when the ring is full,
+// otherwise records are dropped. returns NULL if the file can't be created or the thread can't be started
+Trace *open_trace(const char *path, bool wait);
+// writes the remaining records and closes the file, returns -1 if a write failed
+int close_trace(Trace *trace);
+
+// waits until the ring has room, returns false without waiting if the trace drops records instead
+bool wait_for_trace(Trace *trace);
+
+// appends the instruction at `pc` that was just executed
+static inline void trace_step(Trace *trace, const Chip_8 *chip, uint16_t pc, const Instruction *in) {
+    unsigned int head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+    // the shared tail is only read once the ring looks full
+    if (head - trace->tail_seen == TRACE_RING_SIZE) {
+        trace->tail_seen = atomic_load_explicit(&trace->tail, memory_order_acquire);
+        if (head - trace->tail_seen == TRACE_RING_SIZE && !wait_for_trace(trace)) {
+            trace->cycle++;
+            trace->dropped++;
+            return;
+        }
+    }
+    Trace_Record *record = &trace->records[head & (TRACE_RING_SIZE - 1)];
+    record->cycle = trace->cycle++;
+    record->pc = pc;
+    record->opcode = in->opcode;
+    record->I = chip->I;
+    record->x = in->x;
+    record->vx = chip->V[in->x];
+    atomic_store_explicit(&trace->head, head + 1, memory_order_release);
+}
+
+// reading trace files. returns -1 if the file isn't a trace
+int read_trace_header(FILE *file, uint64_t *dropped);
+// returns false at the end of the file
+bool read_trace_record(FILE *file, Trace_Record *record);
+
+#ifdef CHIP8_TRACE
+#define TRACE_PC(pc, chip) uint16_t pc = (chip)->PC
+#define TRACE_STEP(chip, pc, in) do { if ((chip)->trace) trace_step((chip)->trace, (chip), (pc), (in)); } while (0)
+#define TRACE_SKIP(chip, cycles) do { if ((chip)->trace) (chip)->trace->cycle += (cycles); } while (0)
+#else
+#define TRACE_PC(pc, chip) ((void) 0)
+#define TRACE_STEP(chip, pc, in) ((void) 0)
+#define TRACE_SKIP(chip, cycles) ((void) 0)
+#endif
+
+#endif //CHIP_8_TRACE_H
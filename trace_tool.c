@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "trace.h"
+#include "disasm.h"
+
+// reads the traces written with -T by builds with CHIP8_TRACE.
+//
+// usage: chip8_trace <trace> [-p first-last] [-o opcode] [-n count]
+//        chip8_trace -d <trace> <trace> [-C context]
+// the first form lists the records, -p keeps the instructions at addresses first to last (hex), -o the
+// opcodes matching a pattern where x, y, n and k match any digit (e.g. 8xy4 or Fx1E), -n stops after
+// `count` records.
+// -d compares two traces of the same rom, e.g. from two engines, and shows the first record where they
+// differ after `context` matching ones (default 8). exits with 1 if the traces differ
+
+#define DEFAULT_CONTEXT 8
+#define MAX_CONTEXT 256
+
+typedef struct Filter {
+    unsigned int first, last;
+    uint16_t mask, value; // opcode & mask == value
+    unsigned long long count;
+} Filter;
+
+static void usage() {
+    printf("usage: chip8_trace <trace> [-p first-last] [-o opcode] [-n count]\n");
+    printf("       chip8_trace -d <trace> <trace> [-C context]\n");
+}
+
+static FILE *open_trace_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        printf("could not open %s\n", path);
+        return NULL;
+    }
+    uint64_t dropped;
+    if (read_trace_header(file, &dropped) == -1) {
+        printf("%s is not a trace\n", path);
+        fclose(file);
+        return NULL;
+    }
+    // the cycles stay correct, but the missing instructions can't be listed or compared
+    if (dropped) printf("%s: %llu records were dropped while tracing\n", path, (unsigned long long) dropped);
+    return file;
+}
+
+// the pattern has one character per hex digit of the opcode
+static int parse_pattern(const char *pattern, Filter *filter) {
+    if (strlen(pattern) != 4) return -1;
+    filter->mask = filter->value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = (char) tolower((unsigned char) pattern[i]);
+        filter->mask <<= 4;
+        filter->value <<= 4;
+        if (c == 'x' || c == 'y' || c == 'n' || c == 'k') continue;
+        if (!isxdigit((unsigned char) c)) return -1;
+        filter->mask |= 0xF;
+        filter->value |= isdigit((unsigned char) c) ? c - '0' : c - 'a' + 10;
+    }
+    return 0;
+}
+
+static void print_record(const char *prefix, const Trace_Record *record) {
+    char text[32];
+    // F000 loads the following word into I, which the record holds after executing it
+    disassemble(record->opcode, record->I, text, sizeof(text));
+    printf("%s%10llu  %03X  %04X  %-18s I=%03X V%X=%02X\n", prefix, (unsigned long long) record->cycle, record->pc,
+           record->opcode, text, record->I, record->x, record->vx);
+}
+
+static int list_trace(const char *path, const Filter *filter) {
+    FILE *file = open_trace_file(path);
+    if (!file) return -2;
+    Trace_Record record;
+    unsigned long long shown = 0;
+    while (shown < filter->count && read_trace_record(file, &record)) {
+        if (record.pc < filter->first || record.pc > filter->last) continue;
+        if ((record.opcode & filter->mask) != filter->value) continue;
+        print_record("", &record);
+        shown++;
+    }
+    fclose(file);
+    return 0;
+}
+
+static bool same_record(const Trace_Record *a, const Trace_Record *b) {
+    return a->cycle == b->cycle && a->pc == b->pc && a->opcode == b->opcode && a->I == b->I && a->x == b->x &&
+           a->vx == b->vx;
+}
+
+static int diff_traces(const char *path_a, const char *path_b, unsigned int context) {
+    FILE *a = open_trace_file(path_a);
+    if (!a) return -2;
+    FILE *b = open_trace_file(path_b);
+    if (!b) {
+        fclose(a);
+        return -2;
+    }
+
+    // the last `context` records both traces agree on
+    static Trace_Record history[MAX_CONTEXT];
+    unsigned long long matched = 0;
+    Trace_Record ra, rb;
+    bool more_a, more_b;
+    for (;;) {
+        more_a = read_trace_record(a, &ra);
+        more_b = read_trace_record(b, &rb);
+        if (!more_a || !more_b || !same_record(&ra, &rb)) break;
+        if (context) history[matched % context] = ra;
+        matched++;
+    }
+    fclose(a);
+    fclose(b);
+
+    if (!more_a && !more_b) {
+        printf("traces match, %llu records\n", matched);
+        return 0;
+    }
+    printf("traces differ after %llu records\n", matched);
+    unsigned long long first = matched > context ? matched - context : 0;
+    for (unsigned long long i = first; i < matched; i++) print_record("  ", &history[i % context]);
+    if (more_a) print_record("< ", &ra);
+    else printf("< end of %s\n", path_a);
+    if (more_b) print_record("> ", &rb);
+    else printf("> end of %s\n", path_b);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        usage();
+        return -1;
+    }
+
+    if (strcmp(argv[1], "-d") == 0) {
+        if (argc != 4 && !(argc == 6 && strcmp(argv[4], "-C") == 0)) {
+            usage();
+            return -1;
+        }
+        unsigned long context = argc == 6 ? strtoul(argv[5], NULL, 10) : DEFAULT_CONTEXT;
+        if (context > MAX_CONTEXT) context = MAX_CONTEXT;
+        return diff_traces(argv[2], argv[3], (unsigned int) context);
+    }
+
+    Filter filter = {0, 0xFFFF, 0, 0, ~0ull};
+    for (int i = 2; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage();
+            return -1;
+        }
+        if (strcmp(argv[i], "-p") == 0) {
+            if (sscanf(argv[++i], "%x-%x", &filter.first, &filter.last) != 2) {
+                usage();
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (parse_pattern(argv[++i], &filter) == -1) {
+                usage();
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-n") == 0) filter.count = strtoull(argv[++i], NULL, 10);
+        else {
+            usage();
+            return -1;
+        }
+    }
+    return list_trace(argv[1], &filter);
+}